@@ -3,14 +3,34 @@
 
 #include "exception.h"
 #include "file.h"
+#include "mapped_file.h"
+#include "queue.h"
 #include "string.h"
 #include "typing.h"
 
 #include <avro/DataFile.hh>
 #include <avro/Generic.hh>
+#include <avro/NodeImpl.hh>
+#include <avro/Compiler.hh>
+#include <zlib.h>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
 #include <exception>
+#include <filesystem>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <variant>
 #include <vector>
 
 namespace zpz
@@ -30,436 +50,2341 @@ class AvroError : public Error
 };
 
 
-class AvroReader
+class AvroPath
 {
-    // Reads data from Avro file that contains a single record at the top level.
-    //
-    // The class contains an internal 'cursor' which points to an element in the object.
-    // The cursor is moved around by `seek`, not unlike a `seek` operation in an opened file object.
-    // Usually, you should call `save_cursor` before calling `seek`, and `restore_cursor` after
-    // you're done with the object at the new location, so to restore this pointer to point
-    // to the original element prior to you moving it around.
-    //
-    // The 'current element' means the element being pointed to by the current value
-    // of the internal cursor.
-    //
-    // Most functions in this class accept a 'name hierarchy' in the arguments, called `names`, like
-    //
-    //    "ab", "cd", "ef"
-    //
-    // This specifies element "ab" under the current element, and "cd" under "ab", and "ef" under "cd".
-    // For this to work, it's necessary that the current element as well as "ab" and "cd"
-    // are of `record` type.
-    //
-    // If any name on the hierarchy is "/", it resets the cursor to the very root of the document.
+    // A name hierarchy that has been resolved against a schema into field indices.
     //
-    // `save_cursor` and `restore_cursor` maintains a stack, hence the cursor save/restore operations
-    // can be nested in many levels.
+    // Create one by `AvroReader::make_path` or `AvroWriter::make_path`, then pass it
+    // wherever a name hierarchy is accepted, e.g. `reader.get_scalar<double>(path)`.
+    // Navigating by a path costs no string work; names are checked against the schema
+    // once, when the path is made.
     //
-    // This class is not optimized for speed.
+    // A path always starts at the root of the document, as if it began with "/".
+    // It can only be used with readers and writers of the schema that it was made against.
 
   public:
-    using Datum = avro::GenericDatum;
+    AvroPath() = default;
 
-    AvroReader(char const* data_file)
+    // Number of names in the hierarchy.
+    size_t size() const
     {
-        check_file_exists(data_file);
-        avro::DataFileReader<Datum> reader(data_file);
-        auto schema = reader.readerSchema();
-        _root = Datum(schema);
-        reader.read(_root);
-        if (_root.type() != avro::AVRO_RECORD) {
-            throw AvroError("top level of the AVRO data is not a record type");
-        }
-        auto const& r = _root.value<avro::GenericRecord>();
-        auto name = std::string(r.schema()->name());
-        auto pos = name.find('.');
-        while (pos != std::string::npos) {
-            name = name.substr(pos + 1);
-            pos = name.find('.');
-        } // strip off 'namespace' in 'name'
-        _root_name = name;
-        reader.close();
-
-        _cursor = &_root;
+        return _fields.size();
     }
 
-    ~AvroReader()
-    {
-        _check_cursor();
-    }
+  private:
+    friend class AvroReader;
+    friend class AvroWriter;
 
-    // `name` element at the top level, i.e. the entire Avro file.
-    std::string name() const
+    avro::Node const* _schema = nullptr;
+    std::vector<size_t> _fields;
+
+    template <typename... Names>
+    static AvroPath _make(avro::ValidSchema const& schema, Names&&... names)
     {
-        return _root_name;
+        AvroPath path;
+        path._schema = schema.root().get();
+        path._resolve(schema.root(), schema.root(), std::forward<Names>(names)...);
+        return path;
     }
 
-    // Move internal cursor to point to the element with the specified name hierarchy.
-    template <typename... Names>
-    void seek(Names&&... names)
+    void _resolve(avro::NodePtr const&, avro::NodePtr const&)
     {
-        _cursor = _cseek(_cursor, std::forward<Names>(names)...);
     }
 
-    // Move internal cursor to point to the array element at the specified index in the array
-    // that is specified by the name hierarchy.
     template <typename... Names>
-    void seek_in_array(size_t pos, Names&&... names)
+    void _resolve(avro::NodePtr const& root, avro::NodePtr node, std::string const& name, Names&&... names)
     {
-        _cursor = _cseek_in_array(_cursor, pos, std::forward<Names>(names)...);
+        if ("" == name) {
+            throw AvroError("can not make path with an empty name");
+        }
+
+        if ("/" == name) {
+            _fields.clear();
+            node = root;
+        } else {
+            node = _record_node(node);
+            if (!node) {
+                throw AvroError(make_string(
+                                    "can not make path through '",
+                                    name,
+                                    "' because its parent is not a record"));
+            }
+            size_t idx;
+            if (!node->nameIndex(name, idx)) {
+                throw AvroError(make_string(
+                                    "schema of record '",
+                                    std::string(node->name()),
+                                    "' does not have field named '",
+                                    name,
+                                    "'"));
+            }
+            _fields.push_back(idx);
+            node = node->leafAt(idx);
+        }
+        _resolve(root, node, std::forward<Names>(names)...);
     }
 
-    // Save current cursor so that the location can be restored later.
-    void save_cursor()
+    // The record schema that data of schema `node` takes when it is a record.
+    // A union is accepted if exactly one of its branches is a record.
+    // Returns null if `node` can not be a record.
+    static avro::NodePtr _record_node(avro::NodePtr node)
     {
-        _cursor_stack.push_back(_cursor);
+        if (node->type() == avro::AVRO_SYMBOLIC) {
+            node = avro::resolveSymbol(node);
+        }
+        if (node->type() == avro::AVRO_RECORD) {
+            return node;
+        }
+        if (node->type() == avro::AVRO_UNION) {
+            avro::NodePtr rec;
+            for (size_t i = 0; i < node->leaves(); i++) {
+                auto branch = _record_node(node->leafAt(i));
+                if (branch) {
+                    if (rec) {
+                        return nullptr;
+                    }
+                    rec = branch;
+                }
+            }
+            return rec;
+        }
+        return nullptr;
     }
+};
 
-    // Restore internal cursor to point to the location that is saved
-    // in the immediately previous `save_cursor`.
-    // A stack of saved cursors are maintained, so that this 'save', 'restore'
-    // can be nested.
-    void restore_cursor()
+
+template <typename T>
+class AvroArrayView
+{
+    // Read-only view of an Avro array whose elements are of type `T`.
+    //
+    // Elements are accessed in place inside the decoded record; nothing is copied
+    // unless `copy_to` is called. The view is invalidated when the reader moves on
+    // to the next record.
+
+  public:
+    using Data = std::vector<avro::GenericDatum>;
+
+    class const_iterator
     {
-        if (_cursor_stack.empty()) {
-            throw AvroError("you are trying to restore cursor while no cursor is saved");
+      public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = T const*;
+        using reference = T const&;
+
+        explicit const_iterator(typename Data::const_iterator it)
+            : _it(it)
+        {
         }
-        _cursor = _cursor_stack.back();
-        _cursor_stack.pop_back();
-    }
 
-    template <typename... Names>
-    bool is_record(Names&&... names) const
+        T const& operator*() const
+        {
+            return _it->template value<T>();
+        }
+
+        T const& operator[](difference_type n) const
+        {
+            return _it[n].template value<T>();
+        }
+
+        const_iterator& operator++()
+        {
+            ++_it;
+            return *this;
+        }
+
+        const_iterator operator++(int)
+        {
+            auto z = *this;
+            ++_it;
+            return z;
+        }
+
+        const_iterator& operator--()
+        {
+            --_it;
+            return *this;
+        }
+
+        const_iterator operator--(int)
+        {
+            auto z = *this;
+            --_it;
+            return z;
+        }
+
+        const_iterator& operator+=(difference_type n)
+        {
+            _it += n;
+            return *this;
+        }
+
+        const_iterator& operator-=(difference_type n)
+        {
+            _it -= n;
+            return *this;
+        }
+
+        const_iterator operator+(difference_type n) const
+        {
+            return const_iterator(_it + n);
+        }
+
+        const_iterator operator-(difference_type n) const
+        {
+            return const_iterator(_it - n);
+        }
+
+        difference_type operator-(const_iterator const& other) const
+        {
+            return _it - other._it;
+        }
+
+        bool operator==(const_iterator const& other) const
+        {
+            return _it == other._it;
+        }
+
+        bool operator!=(const_iterator const& other) const
+        {
+            return _it != other._it;
+        }
+
+        bool operator<(const_iterator const& other) const
+        {
+            return _it < other._it;
+        }
+
+      private:
+        typename Data::const_iterator _it;
+    };
+
+    explicit AvroArrayView(Data const& data)
+        : _data(&data)
     {
-        return _cseek(std::forward<Names>(names)...)->type() == avro::AVRO_RECORD;
     }
 
-    template <typename... Names>
-    bool is_array(Names&&... names) const
+    size_t size() const
     {
-        return _cseek(std::forward<Names>(names)...)->type() == avro::AVRO_ARRAY;
+        return _data->size();
     }
 
-    template <typename... Names>
-    bool is_string(Names&&... names) const
+    bool empty() const
     {
-        return _cseek(std::forward<Names>(names)...)->type() == avro::AVRO_STRING;
+        return _data->empty();
     }
 
-    template <typename... Names>
-    bool is_int(Names&&... names) const
+    T const& operator[](size_t pos) const
     {
-        return _cseek(std::forward<Names>(names)...)->type() == avro::AVRO_INT;
+        return (*_data)[pos].template value<T>();
     }
 
-    template <typename... Names>
-    bool is_long(Names&&... names) const
+    const_iterator begin() const
     {
-        return _cseek(std::forward<Names>(names)...)->type() == avro::AVRO_LONG;
+        return const_iterator(_data->cbegin());
     }
 
-    template <typename... Names>
-    bool is_double(Names&&... names) const
+    const_iterator end() const
     {
-        return _cseek(std::forward<Names>(names)...)->type() == avro::AVRO_DOUBLE;
+        return const_iterator(_data->cend());
     }
 
-    template <typename... Names>
-    bool is_float(Names&&... names) const
+    // Copy the elements into contiguous storage starting at `out`,
+    // which must have room for `size()` elements.
+    void copy_to(T* out) const
     {
-        return _cseek(std::forward<Names>(names)...)->type() == avro::AVRO_FLOAT;
+        for (auto const& v : *_data) {
+            *out++ = v.template value<T>();
+        }
     }
 
-    template <typename... Names>
-    bool is_bool(Names&&... names) const
+  private:
+    Data const* _data;
+};
+
+
+class AvroMappedInputStream : public avro::SeekableInputStream
+{
+    // `avro::InputStream` over a memory-mapped file.
+    //
+    // `next` hands out the mapped bytes directly, so the data goes from the page cache
+    // to the decoder without `read` calls or copies, and processes reading the same file
+    // share its pages.
+
+  public:
+    explicit AvroMappedInputStream(char const* data_file)
+        : _file(data_file, MADV_SEQUENTIAL)
     {
-        return _cseek(std::forward<Names>(names)...)->type() == avro::AVRO_BOOL;
+        _file.advise(MADV_WILLNEED);
     }
 
-    template <typename... Names>
-    bool is_string_array(Names&&... names) const
+    bool next(uint8_t const** data, size_t* len) override
     {
-        return _is_typed_array(_cseek(_cursor, std::forward<Names>(names)...), avro::AVRO_STRING);
+        if (_pos >= _file.size()) {
+            return false;
+        }
+        *data = reinterpret_cast<uint8_t const*>(_file.data()) + _pos;
+        *len = _file.size() - _pos;
+        _pos = _file.size();
+        return true;
     }
 
-    template <typename... Names>
-    bool is_int_array(Names&&... names) const
+    void backup(size_t len) override
     {
-        return _is_typed_array(_cseek(_cursor, std::forward<Names>(names)...), avro::AVRO_INT);
+        _pos -= std::min(len, _pos);
     }
 
-    template <typename... Names>
-    bool is_long_array(Names&&... names) const
+    void skip(size_t len) override
     {
-        return _is_typed_array(_cseek(_cursor, std::forward<Names>(names)...), avro::AVRO_LONG);
+        _pos = std::min(_pos + len, _file.size());
     }
 
-    template <typename... Names>
-    bool is_double_array(Names&&... names) const
+    size_t byteCount() const override
     {
-        return _is_typed_array(_cseek(_cursor, std::forward<Names>(names)...), avro::AVRO_DOUBLE);
+        return _pos;
     }
 
-    template <typename... Names>
-    bool is_float_array(Names&&... names) const
+    void seek(int64_t position) override
     {
-        return _is_typed_array(_cseek(_cursor, std::forward<Names>(names)...), avro::AVRO_FLOAT);
+        _pos = std::min(static_cast<size_t>(position), _file.size());
     }
 
-    template <typename... Names>
-    bool is_bool_array(Names&&... names) const
+  private:
+    MappedFile _file;
+    size_t _pos = 0;
+};
+
+
+class AvroStringColumn
+{
+    // A column of strings stored back to back in a single buffer.
+    // String `i` occupies `chars()[offsets()[i]]` up to `chars()[offsets()[i + 1]]`.
+
+  public:
+    using value_type = std::string;
+
+    size_t size() const
     {
-        return _is_typed_array(_cseek(_cursor, std::forward<Names>(names)...), avro::AVRO_BOOL);
+        return _offsets.size() - 1;
     }
 
-    // Whether the element specified by the name hierarchy exists.
-    template <typename... Names>
-    bool has_member(std::string const& name, Names&&... names) const
+    std::string_view operator[](size_t pos) const
     {
-        return _has_member(_cursor, name, std::forward<Names>(names)...);
+        return std::string_view(_chars.data() + _offsets[pos], _offsets[pos + 1] - _offsets[pos]);
     }
 
-    // Size of the array element specified by the name hierarchy.
-    template <typename... Names>
-    size_t get_array_size(Names&&... names) const
+    std::string const& chars() const
     {
-        return _get_array_size(_cseek(_cursor, std::forward<Names>(names)...));
+        return _chars;
     }
 
-    // Number of entries in the record object specified by the name hierarchy.
-    template <typename... Names>
-    size_t get_record_size(Names&&... names) const
+    std::vector<size_t> const& offsets() const
     {
-        return _get_record_size(_cseek(_cursor, std::forward<Names>(names)...));
+        return _offsets;
     }
 
-    // Get the scalar value of the element specified by the name hierarchy.
-    // The element must be a scalar that is compatible with type `T`.
-    // `T` should be one of `int`, `double`, `std::string`.
-    template <typename T, typename... Names>
-    const T get_scalar(Names&&... names) const
+    // Reserve room for `n` strings of `n_chars` bytes in total.
+    void reserve(size_t n, size_t n_chars = 0)
     {
-        auto cursor = _cseek(_cursor, std::forward<Names>(names)...);
-        return _get_scalar<T>(cursor);
+        _offsets.reserve(n + 1);
+        _chars.reserve(n_chars);
     }
 
-    // Get the scalar value at the specified index in the specified array element.
-    template <typename T, typename... Names>
-    T get_scalar_in_array(size_t pos, Names&&... names) const
+    void push_back(std::string const& x)
     {
-        auto cursor = _cseek_in_array(_cursor, pos, std::forward<Names>(names)...);
-        return _get_scalar<T>(cursor);
+        _chars.append(x);
+        _offsets.push_back(_chars.size());
     }
 
-    // Get the vector value of the specified array element.
-    // The specified element must be an array and contains elements of a type compatible with `T`.
-    template <typename T, typename... Names>
-    std::vector<T> get_vector(Names&&... names) const
+  private:
+    std::string _chars;
+    std::vector<size_t> _offsets = {0};
+};
+
+
+class AvroColumns
+{
+    // The scalar fields of an array of records, as one contiguous column per field.
+    //
+    // Columns of `int`, `long`, `float`, `double` and `bool` fields are `std::vector`s
+    // of the respective type; columns of `string` fields are `AvroStringColumn`s.
+    // Fields of other types, including unions, are not extracted.
+    //
+    // Usually obtained by `AvroReader::get_columns`.
+
+  public:
+    // Extract the columns in a single pass over the array. String columns take
+    // another pass over their fields beforehand, to size their buffers exactly.
+    explicit AvroColumns(avro::GenericArray const& arr)
     {
-        auto cursor = _cseek(_cursor, std::forward<Names>(names)...);
-        return _get_vector<T>(cursor);
+        auto item = arr.schema()->leafAt(0);
+        if (item->type() == avro::AVRO_SYMBOLIC) {
+            item = avro::resolveSymbol(item);
+        }
+        if (item->type() != avro::AVRO_RECORD) {
+            throw AvroError(make_string(
+                                "can not extract columns from array with elements of type '",
+                                avro::toString(item->type()),
+                                "'; 'record' is expected"));
+        }
+
+        auto const& data = arr.value();
+        _size = data.size();
+
+        std::vector<size_t> fields;
+        for (size_t i = 0; i < item->leaves(); i++) {
+            auto leaf = item->leafAt(i);
+            if (leaf->type() == avro::AVRO_SYMBOLIC) {
+                leaf = avro::resolveSymbol(leaf);
+            }
+            switch (leaf->type()) {
+                case avro::AVRO_INT:
+                    _add_column<std::vector<int>>(item->nameAt(i));
+                    break;
+                case avro::AVRO_LONG:
+                    _add_column<std::vector<long>>(item->nameAt(i));
+                    break;
+                case avro::AVRO_FLOAT:
+                    _add_column<std::vector<float>>(item->nameAt(i));
+                    break;
+                case avro::AVRO_DOUBLE:
+                    _add_column<std::vector<double>>(item->nameAt(i));
+                    break;
+                case avro::AVRO_BOOL:
+                    _add_column<std::vector<bool>>(item->nameAt(i));
+                    break;
+                case avro::AVRO_STRING:
+                    _add_column<AvroStringColumn>(item->nameAt(i));
+                    break;
+                default:
+                    continue;
+            }
+            fields.push_back(i);
+        }
+
+        for (size_t j = 0; j < fields.size(); j++) {
+            if (auto col = std::get_if<AvroStringColumn>(&_columns[j])) {
+                size_t n_chars = 0;
+                for (auto const& d : data) {
+                    n_chars += d.value<avro::GenericRecord>().fieldAt(fields[j]).value<std::string>().size();
+                }
+                col->reserve(_size, n_chars);
+            }
+        }
+
+        for (auto const& d : data) {
+            auto const& rec = d.value<avro::GenericRecord>();
+            for (size_t j = 0; j < fields.size(); j++) {
+                auto const& v = rec.fieldAt(fields[j]);
+                std::visit([&v](auto & col) {
+                    using C = std::decay_t<decltype(col)>;
+                    col.push_back(v.value<typename C::value_type>());
+                }, _columns[j]);
+            }
+        }
     }
 
-    // Get the vector value at the specified index in the specified array element.
-    // The specified element must be an array and contains array elements of type compatible with `vector<T>`.
-    template <typename T, typename... Names>
-    std::vector<T> get_vector_in_array(size_t pos, Names&&... names)
+    // Number of rows, i.e. number of records in the array.
+    size_t size() const
     {
-        auto cursor = _cseek_in_array(_cursor, pos, std::forward<Names>(names)...);
-        return _get_vector<T>(cursor);
+        return _size;
     }
 
-  private:
-    Datum _root;
-    Datum const* _cursor;
-    std::vector<Datum const*> _cursor_stack;
-    std::string _root_name;
+    // Names of the extracted fields, in the order they appear in the record schema.
+    std::vector<std::string> const& names() const
+    {
+        return _names;
+    }
 
-    Datum const* _cseek(Datum const* cursor) const
+    bool has_column(std::string const& name) const
     {
-        return cursor;
+        return std::find(_names.begin(), _names.end(), name) != _names.end();
     }
 
-    template <typename... Names>
-    Datum const* _cseek(Datum const* cursor, std::string const& name, Names&&... names) const
+    // Column of the field `name`, which must be of a type compatible with `T`.
+    // `T` should be one of `int`, `long`, `float`, `double`, `bool`.
+    template <typename T>
+    std::vector<T> const& get(std::string const& name) const
+    {
+        auto z = std::get_if<std::vector<T>>(&_column(name));
+        if (!z) {
+            throw AvroError(make_string("column '", name, "' is not of the requested type"));
+        }
+        return *z;
+    }
+
+    // Column of the string field `name`.
+    AvroStringColumn const& get_strings(std::string const& name) const
+    {
+        auto z = std::get_if<AvroStringColumn>(&_column(name));
+        if (!z) {
+            throw AvroError(make_string("column '", name, "' is not a string column"));
+        }
+        return *z;
+    }
+
+  private:
+    using Column = std::variant <
+                   std::vector<int>,
+                   std::vector<long>,
+                   std::vector<float>,
+                   std::vector<double>,
+                   std::vector<bool>,
+                   AvroStringColumn >;
+
+    size_t _size = 0;
+    std::vector<std::string> _names;
+    std::vector<Column> _columns;
+
+    template <typename C>
+    void _add_column(std::string const& name)
+    {
+        C col;
+        col.reserve(_size);
+        _names.push_back(name);
+        _columns.emplace_back(std::move(col));
+    }
+
+    Column const& _column(std::string const& name) const
+    {
+        auto it = std::find(_names.begin(), _names.end(), name);
+        if (it == _names.end()) {
+            throw AvroError(make_string("there is no column named '", name, "'"));
+        }
+        return _columns[it - _names.begin()];
+    }
+};
+
+
+// Avro type of the C++ type `T`; not defined for unsupported types.
+template <typename T>
+struct avro_type_of;
+
+template <>
+struct avro_type_of<std::string> {
+    static constexpr avro::Type value = avro::AVRO_STRING;
+};
+
+template <>
+struct avro_type_of<int> {
+    static constexpr avro::Type value = avro::AVRO_INT;
+};
+
+template <>
+struct avro_type_of<long> {
+    static constexpr avro::Type value = avro::AVRO_LONG;
+};
+
+template <>
+struct avro_type_of<double> {
+    static constexpr avro::Type value = avro::AVRO_DOUBLE;
+};
+
+template <>
+struct avro_type_of<float> {
+    static constexpr avro::Type value = avro::AVRO_FLOAT;
+};
+
+template <>
+struct avro_type_of<bool> {
+    static constexpr avro::Type value = avro::AVRO_BOOL;
+};
+
+
+class AvroParallelReader;
+
+
+class AvroReader
+{
+    // Reads data from Avro file whose top level consists of records.
+    //
+    // The file is streamed one record at a time. Upon construction the first record is loaded;
+    // `next` decodes the following record into the same buffer, so memory use does not grow
+    // with the number of records in the file. The records can also be visited by a range-for loop:
+    //
+    //    for (auto& record : reader.records()) {
+    //        auto x = record.get_scalar<double>("intercept");
+    //    }
+    //
+    // All navigation functions below operate on the current record.
+    //
+    // The class contains an internal 'cursor' which points to an element in the object.
+    // The cursor is moved around by `seek`, not unlike a `seek` operation in an opened file object.
+    // Usually, you should call `save_cursor` before calling `seek`, and `restore_cursor` after
+    // you're done with the object at the new location, so to restore this pointer to point
+    // to the original element prior to you moving it around.
+    //
+    // The 'current element' means the element being pointed to by the current value
+    // of the internal cursor.
+    //
+    // Most functions in this class accept a 'name hierarchy' in the arguments, called `names`, like
+    //
+    //    "ab", "cd", "ef"
+    //
+    // This specifies element "ab" under the current element, and "cd" under "ab", and "ef" under "cd".
+    // For this to work, it's necessary that the current element as well as "ab" and "cd"
+    // are of `record` type.
+    //
+    // If any name on the hierarchy is "/", it resets the cursor to the very root of the document.
+    //
+    // In place of names, an `AvroPath` created by `make_path` may be used. This is the
+    // fast way to read the same elements of many records.
+    //
+    // `save_cursor` and `restore_cursor` maintains a stack, hence the cursor save/restore operations
+    // can be nested in many levels.
+    //
+    // This class is not optimized for speed.
+
+  public:
+    using Datum = avro::GenericDatum;
+
+    class RecordIterator
+    {
+      public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = AvroReader;
+        using difference_type = std::ptrdiff_t;
+        using pointer = AvroReader*;
+        using reference = AvroReader&;
+
+        explicit RecordIterator(AvroReader* reader)
+            : _reader(reader)
+        {
+        }
+
+        AvroReader& operator*() const
+        {
+            return *_reader;
+        }
+
+        RecordIterator& operator++()
+        {
+            if (!_reader->next()) {
+                _reader = nullptr;
+            }
+            return *this;
+        }
+
+        bool operator==(RecordIterator const& other) const
+        {
+            return _reader == other._reader;
+        }
+
+        bool operator!=(RecordIterator const& other) const
+        {
+            return _reader != other._reader;
+        }
+
+      private:
+        AvroReader* _reader;
+    };
+
+    class RecordRange
+    {
+      public:
+        explicit RecordRange(AvroReader* reader)
+            : _reader(reader)
+        {
+        }
+
+        RecordIterator begin() const
+        {
+            return RecordIterator(_reader->_has_record ? _reader : nullptr);
+        }
+
+        RecordIterator end() const
+        {
+            return RecordIterator(nullptr);
+        }
+
+      private:
+        AvroReader* _reader;
+    };
+
+    AvroReader(char const* data_file)
+    {
+        check_file_exists(data_file);
+        _reader = std::make_unique<avro::DataFileReader<Datum>>(
+                      std::make_unique<AvroMappedInputStream>(data_file));
+        _init_schema(_reader->readerSchema());
+        _has_record = _reader->read(_root);
+        if (!_has_record) {
+            _close();
+        }
+    }
+
+    // Read only the elements specified by the name hierarchies in `keep`, e.g.
+    //
+    //    AvroReader reader("model.avro", {{"coef"}, {"intercept"}});
+    //
+    // Each name hierarchy starts at the top level record. Other fields are skipped
+    // during decoding and do not exist in the records of this reader. A field whose
+    // name hierarchy ends at it is kept in full; a field that is named on the way to
+    // a deeper element is itself pruned, hence it must be a record.
+    AvroReader(char const* data_file, std::vector<std::vector<std::string>> const& keep)
+    {
+        check_file_exists(data_file);
+        auto base = std::make_unique<avro::DataFileReaderBase>(
+                        std::make_unique<AvroMappedInputStream>(data_file));
+        auto schema = _prune_schema(base->dataSchema(), keep);
+        _reader = std::make_unique<avro::DataFileReader<Datum>>(std::move(base), schema);
+        _init_schema(_reader->readerSchema());
+        _has_record = _reader->read(_root);
+        if (!_has_record) {
+            _close();
+        }
+    }
+
+    ~AvroReader()
+    {
+        _check_cursor();
+    }
+
+    // `name` element at the top level, i.e. the entire Avro file.
+    std::string name() const
+    {
+        return _root_name;
+    }
+
+    // Decode the next record in the file into the buffer of the current record,
+    // and reset the cursor to its root.
+    // Returns `false` if there are no more records, in which case the file is closed.
+    bool next()
+    {
+        _check_cursor();
+        _cursor = &_root;
+        if (_reader && _reader->read(_root)) {
+            return true;
+        }
+        _has_record = false;
+        _close();
+        return false;
+    }
+
+    // Range over the records starting at the current one, for use in range-for loops.
+    // Each step of the iteration calls `next`.
+    RecordRange records()
+    {
+        return RecordRange(this);
+    }
+
+    // Resolve the name hierarchy, starting at the root of the document, into field indices
+    // of the schema. Throws if the schema does not have the specified element.
+    // The resulting path remains valid for all records of the file.
+    template <typename... Names>
+    AvroPath make_path(Names&&... names) const
+    {
+        return AvroPath::_make(_schema, std::forward<Names>(names)...);
+    }
+
+    // Move internal cursor to point to the element with the specified name hierarchy.
+    template <typename... Names>
+    void seek(Names&&... names)
+    {
+        _cursor = _cseek(_cursor, std::forward<Names>(names)...);
+    }
+
+    // Move internal cursor to point to the array element at the specified index in the array
+    // that is specified by the name hierarchy.
+    template <typename... Names>
+    void seek_in_array(size_t pos, Names&&... names)
+    {
+        _cursor = _cseek_in_array(_cursor, pos, std::forward<Names>(names)...);
+    }
+
+    // Save current cursor so that the location can be restored later.
+    void save_cursor()
+    {
+        _cursor_stack.push_back(_cursor);
+    }
+
+    // Restore internal cursor to point to the location that is saved
+    // in the immediately previous `save_cursor`.
+    // A stack of saved cursors are maintained, so that this 'save', 'restore'
+    // can be nested.
+    void restore_cursor()
+    {
+        if (_cursor_stack.empty()) {
+            throw AvroError("you are trying to restore cursor while no cursor is saved");
+        }
+        _cursor = _cursor_stack.back();
+        _cursor_stack.pop_back();
+    }
+
+    template <typename... Names>
+    bool is_record(Names&&... names) const
+    {
+        return _cseek(std::forward<Names>(names)...)->type() == avro::AVRO_RECORD;
+    }
+
+    template <typename... Names>
+    bool is_array(Names&&... names) const
+    {
+        return _cseek(std::forward<Names>(names)...)->type() == avro::AVRO_ARRAY;
+    }
+
+    template <typename... Names>
+    bool is_string(Names&&... names) const
+    {
+        return _cseek(std::forward<Names>(names)...)->type() == avro::AVRO_STRING;
+    }
+
+    template <typename... Names>
+    bool is_int(Names&&... names) const
+    {
+        return _cseek(std::forward<Names>(names)...)->type() == avro::AVRO_INT;
+    }
+
+    template <typename... Names>
+    bool is_long(Names&&... names) const
+    {
+        return _cseek(std::forward<Names>(names)...)->type() == avro::AVRO_LONG;
+    }
+
+    template <typename... Names>
+    bool is_double(Names&&... names) const
+    {
+        return _cseek(std::forward<Names>(names)...)->type() == avro::AVRO_DOUBLE;
+    }
+
+    template <typename... Names>
+    bool is_float(Names&&... names) const
+    {
+        return _cseek(std::forward<Names>(names)...)->type() == avro::AVRO_FLOAT;
+    }
+
+    template <typename... Names>
+    bool is_bool(Names&&... names) const
+    {
+        return _cseek(std::forward<Names>(names)...)->type() == avro::AVRO_BOOL;
+    }
+
+    template <typename... Names>
+    bool is_string_array(Names&&... names) const
+    {
+        return _is_typed_array(_cseek(_cursor, std::forward<Names>(names)...), avro::AVRO_STRING);
+    }
+
+    template <typename... Names>
+    bool is_int_array(Names&&... names) const
+    {
+        return _is_typed_array(_cseek(_cursor, std::forward<Names>(names)...), avro::AVRO_INT);
+    }
+
+    template <typename... Names>
+    bool is_long_array(Names&&... names) const
+    {
+        return _is_typed_array(_cseek(_cursor, std::forward<Names>(names)...), avro::AVRO_LONG);
+    }
+
+    template <typename... Names>
+    bool is_double_array(Names&&... names) const
+    {
+        return _is_typed_array(_cseek(_cursor, std::forward<Names>(names)...), avro::AVRO_DOUBLE);
+    }
+
+    template <typename... Names>
+    bool is_float_array(Names&&... names) const
+    {
+        return _is_typed_array(_cseek(_cursor, std::forward<Names>(names)...), avro::AVRO_FLOAT);
+    }
+
+    template <typename... Names>
+    bool is_bool_array(Names&&... names) const
+    {
+        return _is_typed_array(_cseek(_cursor, std::forward<Names>(names)...), avro::AVRO_BOOL);
+    }
+
+    // Whether the element specified by the name hierarchy exists.
+    template <typename... Names>
+    bool has_member(std::string const& name, Names&&... names) const
+    {
+        return _has_member(_cursor, name, std::forward<Names>(names)...);
+    }
+
+    // Size of the array element specified by the name hierarchy.
+    template <typename... Names>
+    size_t get_array_size(Names&&... names) const
+    {
+        return _get_array_size(_cseek(_cursor, std::forward<Names>(names)...));
+    }
+
+    // Number of entries in the record object specified by the name hierarchy.
+    template <typename... Names>
+    size_t get_record_size(Names&&... names) const
+    {
+        return _get_record_size(_cseek(_cursor, std::forward<Names>(names)...));
+    }
+
+    // Get the scalar value of the element specified by the name hierarchy.
+    // The element must be a scalar that is compatible with type `T`.
+    // `T` should be one of `int`, `double`, `std::string`.
+    template <typename T, typename... Names>
+    const T get_scalar(Names&&... names) const
+    {
+        auto cursor = _cseek(_cursor, std::forward<Names>(names)...);
+        return _get_scalar<T>(cursor);
+    }
+
+    // Get the scalar value at the specified index in the specified array element.
+    template <typename T, typename... Names>
+    T get_scalar_in_array(size_t pos, Names&&... names) const
+    {
+        auto cursor = _cseek_in_array(_cursor, pos, std::forward<Names>(names)...);
+        return _get_scalar<T>(cursor);
+    }
+
+    // Get the vector value of the specified array element.
+    // The specified element must be an array and contains elements of a type compatible with `T`.
+    template <typename T, typename... Names>
+    std::vector<T> get_vector(Names&&... names) const
+    {
+        auto cursor = _cseek(_cursor, std::forward<Names>(names)...);
+        return _get_vector<T>(cursor);
+    }
+
+    // Get the vector value at the specified index in the specified array element.
+    // The specified element must be an array and contains array elements of type compatible with `vector<T>`.
+    template <typename T, typename... Names>
+    std::vector<T> get_vector_in_array(size_t pos, Names&&... names)
+    {
+        auto cursor = _cseek_in_array(_cursor, pos, std::forward<Names>(names)...);
+        return _get_vector<T>(cursor);
+    }
+
+    // Get a read-only view of the specified array element, without copying the elements.
+    // The element type is checked against the array schema, hence an empty array is fine.
+    // `T` should be one of `int`, `long`, `float`, `double`, `bool`, `std::string`.
+    // The view is valid until the reader moves on to the next record.
+    template <typename T, typename... Names>
+    AvroArrayView<T> get_array_view(Names&&... names) const
+    {
+        auto cursor = _cseek(_cursor, std::forward<Names>(names)...);
+        return _get_array_view<T>(cursor);
+    }
+
+    // Extract the scalar fields of the specified array of records into one column per field.
+    // See `AvroColumns`.
+    template <typename... Names>
+    AvroColumns get_columns(Names&&... names) const
+    {
+        Datum const* cursor = _cseek(_cursor, std::forward<Names>(names)...);
+        _assert_type(cursor, avro::AVRO_ARRAY);
+        return AvroColumns(cursor->value<avro::GenericArray>());
+    }
+
+    // Copy the elements of the specified array element into the caller's buffer `out`,
+    // which has room for `capacity` elements. Returns the number of elements copied.
+    // Throws if the buffer is too small.
+    template <typename T, typename... Names>
+    size_t copy_vector(T* out, size_t capacity, Names&&... names) const
+    {
+        auto view = get_array_view<T>(std::forward<Names>(names)...);
+        if (view.size() > capacity) {
+            throw AvroError(make_string(
+                                "buffer of capacity ",
+                                capacity,
+                                " is too small for array of size ",
+                                view.size()));
+        }
+        view.copy_to(out);
+        return view.size();
+    }
+
+  private:
+    friend class AvroParallelReader;
+
+    std::unique_ptr<avro::DataFileReader<Datum>> _reader;
+    avro::ValidSchema _schema;
+    Datum _root;
+    Datum const* _cursor;
+    std::vector<Datum const*> _cursor_stack;
+    std::string _root_name;
+    bool _has_record = false;
+
+    // A reader that is not attached to a file. Records are decoded into it by its owner.
+    explicit AvroReader(avro::ValidSchema const& schema)
+    {
+        _init_schema(schema);
+    }
+
+    struct _KeepTree {
+        bool whole = false;
+        std::map<std::string, _KeepTree> children;
+    };
+
+    // Reader schema that contains only the specified elements of the writer schema.
+    // Kept fields retain their order in the writer schema, so that the reader
+    // sees them in the order the resolving decoder produces them.
+    static avro::ValidSchema _prune_schema(
+        avro::ValidSchema const& schema, std::vector<std::vector<std::string>> const& keep)
+    {
+        if (keep.empty()) {
+            throw AvroError("no element is specified to be kept");
+        }
+        _KeepTree tree;
+        for (auto const& names : keep) {
+            if (names.empty()) {
+                throw AvroError("can not keep an element with empty name hierarchy");
+            }
+            auto node = &tree;
+            for (auto const& name : names) {
+                if ("" == name || "/" == name) {
+                    throw AvroError(make_string("can not keep an element named '", name, "'"));
+                }
+                node = &node->children[name];
+            }
+            node->whole = true;
+        }
+
+        std::ostringstream json;
+        std::map<std::string, bool> defined;
+        _write_pruned_schema(json, schema.root(), tree, defined);
+        try {
+            return avro::compileJsonSchemaFromString(json.str());
+        } catch (std::exception const& e) {
+            throw AvroError(make_string("failed to build the schema of kept elements: ", e.what()));
+        }
+    }
+
+    // `defined` maps the full names of the named types whose definitions have been
+    // written to whether they were written in full, so that later uses refer to them
+    // by name. A named type may be defined in a field that is dropped; then its
+    // definition is written at its first use in a kept field.
+    //
+    // A pruned record keeps its name, which schema resolution matches against the writer
+    // schema. Hence a named type that is pruned can not be used anywhere else, whether
+    // in full or pruned along another path, as that would define the name twice.
+    static void _write_pruned_schema(
+        std::ostream& os, avro::NodePtr node, _KeepTree const& tree, std::map<std::string, bool>& defined)
+    {
+        if (tree.whole) {
+            _write_schema(os, node, defined);
+            return;
+        }
+
+        if (node->type() == avro::AVRO_SYMBOLIC) {
+            node = avro::resolveSymbol(node);
+        }
+        if (node->type() != avro::AVRO_RECORD) {
+            throw AvroError(make_string(
+                                "can not keep part of an element of type '",
+                                avro::toString(node->type()),
+                                "'; only records can be pruned"));
+        }
+
+        auto name = node->name().fullname();
+        if (!defined.emplace(name, false).second) {
+            throw AvroError(make_string(
+                                "can not keep part of record '", name,
+                                "', which is also used elsewhere; keep all of it"));
+        }
+        os << "{\"type\": \"record\", \"name\": \"" << name << "\", \"fields\": [";
+        size_t n = 0;
+        for (size_t i = 0; i < node->leaves(); i++) {
+            auto it = tree.children.find(node->nameAt(i));
+            if (it == tree.children.end()) {
+                continue;
+            }
+            if (n++ > 0) {
+                os << ", ";
+            }
+            os << "{\"name\": \"" << node->nameAt(i) << "\", \"type\": ";
+            _write_pruned_schema(os, node->leafAt(i), it->second, defined);
+            os << "}";
+        }
+        os << "]}";
+
+        for (auto const& child : tree.children) {
+            size_t idx;
+            if (!node->nameIndex(child.first, idx)) {
+                throw AvroError(make_string(
+                                    "record '", node->name().fullname(),
+                                    "' does not have field named '", child.first, "'"));
+            }
+        }
+    }
+
+    // Write the schema of `node` in full, except for the named types in `defined`.
+    static void _write_schema(std::ostream& os, avro::NodePtr node, std::map<std::string, bool>& defined)
+    {
+        if (node->type() == avro::AVRO_SYMBOLIC) {
+            node = avro::resolveSymbol(node);
+        }
+        switch (node->type()) {
+            case avro::AVRO_RECORD:
+            case avro::AVRO_ENUM:
+            case avro::AVRO_FIXED: {
+                auto name = node->name().fullname();
+                auto it = defined.find(name);
+                if (it != defined.end() && !it->second) {
+                    throw AvroError(make_string(
+                                        "can not keep part of record '", name,
+                                        "', which is also used elsewhere; keep all of it"));
+                }
+                if (it != defined.end()) {
+                    os << "\"" << name << "\"";
+                    break;
+                }
+                defined.emplace(name, true);
+                if (node->type() != avro::AVRO_RECORD) {
+                    node->printJson(os, 0);
+                } else {
+                    os << "{\"type\": \"record\", \"name\": \"" << name << "\", \"fields\": [";
+                    for (size_t i = 0; i < node->leaves(); i++) {
+                        if (i > 0) {
+                            os << ", ";
+                        }
+                        os << "{\"name\": \"" << node->nameAt(i) << "\", \"type\": ";
+                        _write_schema(os, node->leafAt(i), defined);
+                        os << "}";
+                    }
+                    os << "]}";
+                }
+                break;
+            }
+            case avro::AVRO_ARRAY:
+                os << "{\"type\": \"array\", \"items\": ";
+                _write_schema(os, node->leafAt(0), defined);
+                os << "}";
+                break;
+            case avro::AVRO_MAP:
+                // The first leaf of a map is its key type, always string.
+                os << "{\"type\": \"map\", \"values\": ";
+                _write_schema(os, node->leafAt(1), defined);
+                os << "}";
+                break;
+            case avro::AVRO_UNION:
+                os << "[";
+                for (size_t i = 0; i < node->leaves(); i++) {
+                    if (i > 0) {
+                        os << ", ";
+                    }
+                    _write_schema(os, node->leafAt(i), defined);
+                }
+                os << "]";
+                break;
+            default:
+                node->printJson(os, 0);
+        }
+    }
+
+    void _init_schema(avro::ValidSchema const& schema)
+    {
+        _schema = schema;
+        _root = Datum(_schema);
+        if (_root.type() != avro::AVRO_RECORD) {
+            throw AvroError("top level of the AVRO data is not a record type");
+        }
+        auto const& r = _root.value<avro::GenericRecord>();
+        auto name = std::string(r.schema()->name());
+        auto pos = name.find('.');
+        while (pos != std::string::npos) {
+            name = name.substr(pos + 1);
+            pos = name.find('.');
+        } // strip off 'namespace' in 'name'
+        _root_name = name;
+
+        _cursor = &_root;
+    }
+
+    void _close()
+    {
+        if (_reader) {
+            _reader->close();
+            _reader.reset();
+        }
+    }
+
+    Datum const* _cseek(Datum const* cursor) const
+    {
+        return cursor;
+    }
+
+    template <typename... Names>
+    Datum const* _cseek(Datum const* cursor, std::string const& name, Names&&... names) const
+    {
+        if ("" == name) {
+            throw AvroError("can not seek an element with empty name");
+        }
+
+        // Re-position the cursor at the root of the doc.
+        if ("/" == name) {
+            cursor = &_root;
+        } else {
+            if (cursor->type() != avro::AVRO_RECORD) {
+                throw AvroError(make_string(
+                                    "can not seek element '",
+                                    name,
+                                    "' because curent element is not pointing at a AVRO_RECORD; actual type is '",
+                                    avro::toString(cursor->type()),
+                                    "'"));
+            }
+            auto const& rec = cursor->value<avro::GenericRecord>();
+            if (!rec.hasField(name)) {
+                throw AvroError(make_string(
+                                    "current record does not have field named '",
+                                    name,
+                                    "'"));
+            }
+            cursor = &rec.field(name);
+        }
+        return _cseek(cursor, std::forward<Names>(names)...);
+    }
+
+    template <typename... Names>
+    Datum const* _cseek(Datum const* cursor, AvroPath const& path, Names&&... names) const
+    {
+        if (path._schema != _schema.root().get()) {
+            throw AvroError("the path was not made against the schema of this reader");
+        }
+        cursor = &_root;
+        for (auto idx : path._fields) {
+            if (cursor->type() != avro::AVRO_RECORD) {
+                throw AvroError(make_string(
+                                    "can not follow path because current element is not pointing at a AVRO_RECORD; actual type is '",
+                                    avro::toString(cursor->type()),
+                                    "'"));
+            }
+            cursor = &cursor->value<avro::GenericRecord>().fieldAt(idx);
+        }
+        return _cseek(cursor, std::forward<Names>(names)...);
+    }
+
+    template <typename... Names>
+    Datum const* _cseek_in_array(Datum const* cursor, size_t pos, Names&&... names) const
+    {
+        cursor = _cseek(cursor, std::forward<Names>(names)...);
+        _assert_type(cursor, avro::AVRO_ARRAY);
+        auto const& data = cursor->value<avro::GenericArray>().value(); // std::vector<GenericDatum>
+        auto n = data.size();
+        if (pos >= n) {
+            throw AvroError(make_string(
+                                "out of bounds: can not seek item <",
+                                pos,
+                                "> in array because array size is ",
+                                n));
+        }
+        return &data[pos];
+    }
+
+    size_t _get_array_size(Datum const* cursor) const
+    {
+        _assert_type(cursor, avro::AVRO_ARRAY);
+        auto const& data = cursor->value<avro::GenericArray>().value();
+        return data.size();
+    }
+
+    size_t _get_record_size(Datum const* cursor) const
+    {
+        _assert_type(cursor, avro::AVRO_RECORD);
+        auto const& rec = cursor->value<avro::GenericRecord>();
+        return rec.fieldCount();
+    }
+
+    avro::Type _get_array_elem_type(Datum const* cursor) const
+    {
+        _assert_type(cursor, avro::AVRO_ARRAY);
+        auto n = _get_array_size(cursor);
+        if (n < 1) {
+            throw AvroError("can not determine element type of an empty array");
+        }
+        return _cseek_in_array(cursor, 0)->type();
+    }
+
+    void _assert_type(Datum const* cursor, avro::Type const& t) const
+    {
+        if (cursor->type() != t) {
+            throw AvroError(make_string(
+                                "encountered element of type '", avro::toString(cursor->type()),
+                                "' while type '", avro::toString(t), "' is expected"));
+        }
+    }
+
+    bool _is_typed_array(Datum const* cursor, avro::Type const& t) const
+    {
+        if (cursor->type() != avro::AVRO_ARRAY) {
+            return false;
+        }
+        return _get_array_elem_type(cursor) == t;
+    }
+
+    void _assert_array_elem_type(Datum const* cursor, avro::Type const& t) const
+    {
+        auto tt = _get_array_elem_type(cursor);
+        if (t != tt) {
+            throw AvroError(make_string(
+                                "encountered array with elements of type '", avro::toString(tt),
+                                "' while type '", avro::toString(t), "' is expected"));
+        }
+    }
+
+    template <typename T>
+    AvroArrayView<T> _get_array_view(Datum const* cursor) const
+    {
+        _assert_type(cursor, avro::AVRO_ARRAY);
+        auto const& arr = cursor->value<avro::GenericArray>();
+        auto item = arr.schema()->leafAt(0);
+        if (item->type() == avro::AVRO_SYMBOLIC) {
+            item = avro::resolveSymbol(item);
+        }
+        auto t = avro_type_of<T>::value;
+        if (item->type() != t) {
+            throw AvroError(make_string(
+                                "encountered array with elements of type '", avro::toString(item->type()),
+                                "' while type '", avro::toString(t), "' is expected"));
+        }
+        return AvroArrayView<T>(arr.value());
+    }
+
+    template <typename... Names>
+    bool _has_member(Datum const* cursor, std::string const& name, Names&&... names) const
+    {
+        if constexpr (sizeof...(names) == 0) {
+            if (cursor->type() == avro::AVRO_RECORD) {
+                auto rec = cursor->value<avro::GenericRecord>();
+                return rec.hasField(name);
+            }
+            throw AvroError(make_string(
+                                "'has_member' needs an element of type 'record', but current element has type '",
+                                avro::toString(cursor->type()),
+                                "'"));
+        } else {
+            return _has_member(_cseek(cursor, name), std::forward<Names>(names)...);
+        }
+    }
+
+    template <typename T>
+    T _get_scalar(Datum const* cursor) const
+    {
+        _assert_type(cursor, avro_type_of<T>::value);
+        return cursor->value<T>();
+    }
+
+    template <typename T>
+    std::vector<T> _get_vector(Datum const* cursor) const
+    {
+        if (cursor->type() != avro::AVRO_ARRAY) {
+            throw AvroError(make_string(
+                                "can not get vector value because current element is not AVRO_ARRAY, ",
+                                "but rather ",
+                                avro::toString(cursor->type())));
+        }
+
+        _assert_array_elem_type(cursor, avro_type_of<T>::value);
+
+        auto const& data = cursor->value<avro::GenericArray>().value();
+        std::vector<T> value;
+        value.reserve(_get_array_size(cursor));
+        for (auto const& v : data) {
+            value.push_back(v.value<T>());
+        }
+        return std::move(value);
+    }
+
+    void _check_cursor() const
+    {
+        if (!_cursor_stack.empty()) {
+            throw AvroError("`save_cursor` is not balanced out by `restore_cursor`");
+        }
+    }
+};
+
+
+inline void avro_decode_value(avro::Decoder& d, std::string& x)
+{
+    d.decodeString(x);
+}
+
+inline void avro_decode_value(avro::Decoder& d, int& x)
+{
+    x = d.decodeInt();
+}
+
+inline void avro_decode_value(avro::Decoder& d, long& x)
+{
+    x = d.decodeLong();
+}
+
+inline void avro_decode_value(avro::Decoder& d, double& x)
+{
+    x = d.decodeDouble();
+}
+
+inline void avro_decode_value(avro::Decoder& d, float& x)
+{
+    x = d.decodeFloat();
+}
+
+inline void avro_decode_value(avro::Decoder& d, bool& x)
+{
+    x = d.decodeBool();
+}
+
+// Decode an array into `x`, reusing the existing elements and capacity of `x`.
+template <typename T>
+void avro_decode_value(avro::Decoder& d, std::vector<T>& x)
+{
+    size_t k = 0;
+    for (size_t n = d.arrayStart(); n != 0; n = d.arrayNext()) {
+        for (size_t i = 0; i < n; i++, k++) {
+            if (k == x.size()) {
+                x.emplace_back();
+            }
+            avro_decode_value(d, x[k]);
+        }
+    }
+    x.resize(k);
+}
+
+inline void avro_decode_value(avro::Decoder& d, std::vector<bool>& x)
+{
+    x.clear();
+    for (size_t n = d.arrayStart(); n != 0; n = d.arrayNext()) {
+        for (size_t i = 0; i < n; i++) {
+            x.push_back(d.decodeBool());
+        }
+    }
+}
+
+// Skip over a value of schema `node` without materializing it.
+inline void avro_skip_value(avro::Decoder& d, avro::NodePtr const& node)
+{
+    switch (node->type()) {
+        case avro::AVRO_NULL:
+            d.decodeNull();
+            break;
+        case avro::AVRO_BOOL:
+            d.decodeBool();
+            break;
+        case avro::AVRO_INT:
+            d.decodeInt();
+            break;
+        case avro::AVRO_LONG:
+            d.decodeLong();
+            break;
+        case avro::AVRO_FLOAT:
+            d.decodeFloat();
+            break;
+        case avro::AVRO_DOUBLE:
+            d.decodeDouble();
+            break;
+        case avro::AVRO_STRING:
+            d.skipString();
+            break;
+        case avro::AVRO_BYTES:
+            d.skipBytes();
+            break;
+        case avro::AVRO_FIXED:
+            d.skipFixed(node->fixedSize());
+            break;
+        case avro::AVRO_ENUM:
+            d.decodeEnum();
+            break;
+        case avro::AVRO_RECORD:
+            for (size_t i = 0; i < node->leaves(); i++) {
+                avro_skip_value(d, node->leafAt(i));
+            }
+            break;
+        case avro::AVRO_ARRAY:
+            for (size_t n = d.skipArray(); n != 0; n = d.skipArray()) {
+                for (size_t i = 0; i < n; i++) {
+                    avro_skip_value(d, node->leafAt(0));
+                }
+            }
+            break;
+        case avro::AVRO_MAP:
+            for (size_t n = d.skipMap(); n != 0; n = d.skipMap()) {
+                for (size_t i = 0; i < n; i++) {
+                    d.skipString();
+                    avro_skip_value(d, node->leafAt(1));
+                }
+            }
+            break;
+        case avro::AVRO_UNION:
+            avro_skip_value(d, node->leafAt(d.decodeUnionIndex()));
+            break;
+        case avro::AVRO_SYMBOLIC:
+            avro_skip_value(d, avro::resolveSymbol(node));
+            break;
+        default:
+            throw AvroError(make_string("can not skip value of type '", avro::toString(node->type()), "'"));
+    }
+}
+
+
+template <typename T>
+class AvroStructBinding
+{
+    // Declarative mapping from fields of an Avro record to members of the struct `T`, e.g.
+    //
+    //    struct Model {
+    //        std::vector<double> coef;
+    //        double intercept;
+    //    };
+    //
+    //    auto binding = AvroStructBinding<Model>()
+    //                   .field("coef", &Model::coef)
+    //                   .field("intercept", &Model::intercept);
+    //
+    // Members may be of type `int`, `long`, `float`, `double`, `bool`, `std::string`,
+    // or `std::vector` of these. Record fields that are not bound are skipped.
+    // The binding is checked against the schema of the data by `AvroStructReader`.
+
+  public:
+    struct Field {
+        std::string name;
+        avro::Type type;
+        bool is_array;
+        std::function<void(avro::Decoder&, T&)> decode;
+    };
+
+    template <typename M>
+    AvroStructBinding& field(std::string const& name, M T::*member)
+    {
+        _fields.push_back(Field{name, _type_of<M>::value, _type_of<M>::is_array,
+                                [member](avro::Decoder & d, T & x) {
+                                    avro_decode_value(d, x.*member);
+                                }});
+        return *this;
+    }
+
+    std::vector<Field> const& fields() const
+    {
+        return _fields;
+    }
+
+  private:
+    std::vector<Field> _fields;
+
+    template <typename M>
+    struct _type_of {
+        static constexpr avro::Type value = avro_type_of<M>::value;
+        static constexpr bool is_array = false;
+    };
+
+    template <typename M>
+    struct _type_of<std::vector<M>> {
+        static constexpr avro::Type value = avro_type_of<M>::value;
+        static constexpr bool is_array = true;
+    };
+};
+
+
+template <typename T>
+class AvroStructReader
+{
+    // Decodes records of an Avro file directly into the struct `T`,
+    // according to an `AvroStructBinding<T>`.
+    //
+    // The binding is resolved against the schema of the file once, at construction;
+    // decoding then reads straight off the `avro::Decoder` without building
+    // `avro::GenericDatum` trees or checking types.
+    //
+    //    AvroStructReader<Model> reader("model.avro", binding);
+    //    Model m;
+    //    while (reader.read(m)) {
+    //        ...
+    //    }
+
+  public:
+    AvroStructReader(char const* data_file, AvroStructBinding<T> const& binding)
+    {
+        check_file_exists(data_file);
+        _reader = std::make_unique<avro::DataFileReaderBase>(
+                      std::make_unique<AvroMappedInputStream>(data_file));
+        _reader->init();
+
+        auto root = _reader->dataSchema().root();
+        if (root->type() != avro::AVRO_RECORD) {
+            throw AvroError("top level of the AVRO data is not a record type");
+        }
+
+        _steps.resize(root->leaves());
+        for (size_t i = 0; i < root->leaves(); i++) {
+            _steps[i].node = root->leafAt(i);
+        }
+        for (auto const& f : binding.fields()) {
+            size_t idx;
+            if (!root->nameIndex(f.name, idx)) {
+                throw AvroError(make_string("record does not have field named '", f.name, "'"));
+            }
+            auto node = _resolve(root->leafAt(idx));
+            if (f.is_array) {
+                if (node->type() != avro::AVRO_ARRAY) {
+                    throw AvroError(make_string(
+                                        "field '", f.name, "' has type '", avro::toString(node->type()),
+                                        "' while type '", avro::toString(avro::AVRO_ARRAY), "' is expected"));
+                }
+                node = _resolve(node->leafAt(0));
+            }
+            if (node->type() != f.type) {
+                throw AvroError(make_string(
+                                    "field '", f.name, "' has ", (f.is_array ? "elements of " : ""),
+                                    "type '", avro::toString(node->type()),
+                                    "' while type '", avro::toString(f.type), "' is expected"));
+            }
+            _steps[idx].decode = f.decode;
+        }
+    }
+
+    ~AvroStructReader()
+    {
+        _reader->close();
+    }
+
+    // Decode the next record into `x`. Members that are not bound are left untouched.
+    // Returns `false` if there are no more records.
+    bool read(T& x)
+    {
+        if (!_reader->hasMore()) {
+            return false;
+        }
+        _reader->decr();
+        auto& d = _reader->decoder();
+        for (auto const& step : _steps) {
+            if (step.decode) {
+                step.decode(d, x);
+            } else {
+                avro_skip_value(d, step.node);
+            }
+        }
+        return true;
+    }
+
+  private:
+    struct Step {
+        avro::NodePtr node;
+        std::function<void(avro::Decoder&, T&)> decode;
+    };
+
+    std::unique_ptr<avro::DataFileReaderBase> _reader;
+    std::vector<Step> _steps;
+
+    static avro::NodePtr _resolve(avro::NodePtr const& node)
+    {
+        if (node->type() == avro::AVRO_SYMBOLIC) {
+            return avro::resolveSymbol(node);
+        }
+        return node;
+    }
+};
+
+
+class AvroWriter
+{
+    // Writes records to an Avro object container file.
+    //
+    // The design mirrors that of `AvroReader`. The writer holds one record, initialized
+    // to the default values of the schema. Elements of the record are addressed by
+    // name hierarchies (or `AvroPath`s) relative to an internal cursor, which is moved
+    // by `seek` and saved/restored by `save_cursor`/`restore_cursor`. Once the values
+    // are set, `write` appends the record to the file. The record keeps its values
+    // after `write`, so only the elements that change need to be set for the next record.
+    //
+    //    AvroWriter writer("model.avro", schema, 1 << 20, avro::DEFLATE_CODEC);
+    //    writer.set_vector(coef, "coef");
+    //    writer.set_scalar(0.5, "intercept");
+    //    writer.write();
+    //
+    // Records are collected into blocks of about `block_size` bytes, which are
+    // compressed as a whole if `codec` is `avro::DEFLATE_CODEC`.
+    //
+    // When a value is set on an element of a union type, the branch of the matching
+    // type is selected.
+
+  public:
+    using Datum = avro::GenericDatum;
+
+    AvroWriter(char const* data_file,
+               avro::ValidSchema const& schema,
+               size_t block_size = 64 * 1024,
+               avro::Codec codec = avro::NULL_CODEC)
+        : _schema(schema)
+        , _root(schema)
+    {
+        if (_root.type() != avro::AVRO_RECORD) {
+            throw AvroError("top level of the AVRO schema is not a record type");
+        }
+        _writer = std::make_unique<avro::DataFileWriter<Datum>>(data_file, _schema, block_size, codec);
+        _cursor = _Cursor{&_root, _schema.root()};
+    }
+
+    AvroWriter(char const* data_file,
+               std::string const& schema_json,
+               size_t block_size = 64 * 1024,
+               avro::Codec codec = avro::NULL_CODEC)
+        : AvroWriter(data_file, avro::compileJsonSchemaFromString(schema_json), block_size, codec)
+    {
+    }
+
+    ~AvroWriter()
+    {
+        close();
+    }
+
+    // See `AvroReader::make_path`.
+    template <typename... Names>
+    AvroPath make_path(Names&&... names) const
+    {
+        return AvroPath::_make(_schema, std::forward<Names>(names)...);
+    }
+
+    template <typename... Names>
+    void seek(Names&&... names)
+    {
+        _cursor = _seek(_cursor, std::forward<Names>(names)...);
+    }
+
+    void save_cursor()
+    {
+        _cursor_stack.push_back(_cursor);
+    }
+
+    void restore_cursor()
+    {
+        if (_cursor_stack.empty()) {
+            throw AvroError("you are trying to restore cursor while no cursor is saved");
+        }
+        _cursor = _cursor_stack.back();
+        _cursor_stack.pop_back();
+    }
+
+    // Set the value of the scalar element specified by the name hierarchy.
+    // `T` should be one of `int`, `long`, `float`, `double`, `bool`, `std::string`.
+    template <typename T, typename... Names>
+    void set_scalar(T const& value, Names&&... names)
+    {
+        auto c = _seek(_cursor, std::forward<Names>(names)...);
+        _set_type(c, avro_type_of<T>::value);
+        c.datum->template value<T>() = value;
+    }
+
+    // Set the content of the array element specified by the name hierarchy.
+    template <typename T, typename... Names>
+    void set_vector(std::vector<T> const& values, Names&&... names)
+    {
+        _set_vector<T>(_seek(_cursor, std::forward<Names>(names)...), values.begin(), values.size());
+    }
+
+    // Set the content of the array element specified by the name hierarchy
+    // to the `n` values starting at `values`.
+    template <typename T, typename... Names>
+    void set_vector(T const* values, size_t n, Names&&... names)
+    {
+        _set_vector<T>(_seek(_cursor, std::forward<Names>(names)...), values, n);
+    }
+
+    // Reset all elements of the record to the default values of the schema.
+    void clear()
+    {
+        _check_cursor();
+        _root = Datum(_schema);
+        _cursor = _Cursor{&_root, _schema.root()};
+    }
+
+    // Append the record to the file.
+    void write()
+    {
+        if (!_writer) {
+            throw AvroError("can not write to a closed file");
+        }
+        _writer->write(_root);
+    }
+
+    // Write out the current block, even if it has not reached the block size.
+    void flush()
+    {
+        if (_writer) {
+            _writer->flush();
+        }
+    }
+
+    void close()
+    {
+        if (_writer) {
+            _writer->close();
+            _writer.reset();
+        }
+    }
+
+  private:
+    // Element of the record and its schema. The schema is needed to select
+    // union branches, which `avro::GenericDatum` does not expose.
+    struct _Cursor {
+        Datum* datum;
+        avro::NodePtr node;
+    };
+
+    avro::ValidSchema _schema;
+    Datum _root;
+    std::unique_ptr<avro::DataFileWriter<Datum>> _writer;
+    _Cursor _cursor;
+    std::vector<_Cursor> _cursor_stack;
+
+    _Cursor _seek(_Cursor cursor) const
+    {
+        return cursor;
+    }
+
+    template <typename... Names>
+    _Cursor _seek(_Cursor cursor, std::string const& name, Names&&... names)
     {
         if ("" == name) {
             throw AvroError("can not seek an element with empty name");
         }
 
-        // Re-position the cursor at the root of the doc.
         if ("/" == name) {
-            cursor = &_root;
+            cursor = _Cursor{&_root, _schema.root()};
         } else {
-            if (cursor->type() != avro::AVRO_RECORD) {
-                throw AvroError(make_string(
-                                    "can not seek element '",
-                                    name,
-                                    "' because curent element is not pointing at a AVRO_RECORD; actual type is '",
-                                    avro::toString(cursor->type()),
-                                    "'"));
-            }
-            auto const& rec = cursor->value<avro::GenericRecord>();
-            if (!rec.hasField(name)) {
+            _set_type(cursor, avro::AVRO_RECORD);
+            auto& rec = cursor.datum->template value<avro::GenericRecord>();
+            size_t idx;
+            if (!rec.schema()->nameIndex(name, idx)) {
                 throw AvroError(make_string(
                                     "current record does not have field named '",
                                     name,
                                     "'"));
             }
-            cursor = &rec.field(name);
+            cursor = _Cursor{&rec.fieldAt(idx), rec.schema()->leafAt(idx)};
         }
-        return _cseek(cursor, std::forward<Names>(names)...);
+        return _seek(cursor, std::forward<Names>(names)...);
     }
 
     template <typename... Names>
-    Datum const* _cseek_in_array(Datum const* cursor, size_t pos, Names&&... names) const
+    _Cursor _seek(_Cursor cursor, AvroPath const& path, Names&&... names)
     {
-        cursor = _cseek(cursor, std::forward<Names>(names)...);
-        _assert_type(cursor, avro::AVRO_ARRAY);
-        auto const& data = cursor->value<avro::GenericArray>().value(); // std::vector<GenericDatum>
-        auto n = data.size();
-        if (pos >= n) {
-            throw AvroError(make_string(
-                                "out of bounds: can not seek item <",
-                                pos,
-                                "> in array because array size is ",
-                                n));
+        if (path._schema != _schema.root().get()) {
+            throw AvroError("the path was not made against the schema of this writer");
         }
-        return &data[pos];
+        cursor = _Cursor{&_root, _schema.root()};
+        for (auto idx : path._fields) {
+            _set_type(cursor, avro::AVRO_RECORD);
+            auto& rec = cursor.datum->template value<avro::GenericRecord>();
+            cursor = _Cursor{&rec.fieldAt(idx), rec.schema()->leafAt(idx)};
+        }
+        return _seek(cursor, std::forward<Names>(names)...);
     }
 
-    size_t _get_array_size(Datum const* cursor) const
+    static avro::NodePtr _resolve(avro::NodePtr const& node)
     {
-        _assert_type(cursor, avro::AVRO_ARRAY);
-        auto const& data = cursor->value<avro::GenericArray>().value();
-        return data.size();
+        if (node->type() == avro::AVRO_SYMBOLIC) {
+            return avro::resolveSymbol(node);
+        }
+        return node;
     }
 
-    size_t _get_record_size(Datum const* cursor) const
+    // Make sure the element is of type `t`, selecting the union branch of that type
+    // if the element is a union.
+    static void _set_type(_Cursor const& cursor, avro::Type t)
     {
-        _assert_type(cursor, avro::AVRO_RECORD);
-        auto const& rec = cursor->value<avro::GenericRecord>();
-        return rec.fieldCount();
+        auto& d = *cursor.datum;
+        if (d.isUnion() && d.type() != t) {
+            auto node = _resolve(cursor.node);
+            size_t i = 0;
+            while (i < node->leaves() && _resolve(node->leafAt(i))->type() != t) {
+                i++;
+            }
+            if (i == node->leaves()) {
+                throw AvroError(make_string(
+                                    "union does not have a branch of type '", avro::toString(t), "'"));
+            }
+            d.selectBranch(i);
+        }
+        if (d.type() != t) {
+            throw AvroError(make_string(
+                                "encountered element of type '", avro::toString(d.type()),
+                                "' while type '", avro::toString(t), "' is expected"));
+        }
     }
 
-    avro::Type _get_array_elem_type(Datum const* cursor) const
+    // Element schema of the array that the cursor points to.
+    static avro::NodePtr _item_node(_Cursor const& cursor)
     {
-        _assert_type(cursor, avro::AVRO_ARRAY);
-        auto n = _get_array_size(cursor);
-        if (n < 1) {
-            throw AvroError("can not determine element type of an empty array");
+        auto node = _resolve(cursor.node);
+        if (node->type() == avro::AVRO_UNION) {
+            node = _resolve(node->leafAt(cursor.datum->unionBranch()));
         }
-        return _cseek_in_array(cursor, 0)->type();
+        return node->leafAt(0);
     }
 
-    void _assert_type(Datum const* cursor, avro::Type const& t) const
+    // Resize the array once, reusing existing elements, then assign the values in place.
+    template <typename T, typename It>
+    void _set_vector(_Cursor cursor, It values, size_t n)
     {
-        if (cursor->type() != t) {
+        _set_type(cursor, avro::AVRO_ARRAY);
+        auto item = _item_node(cursor);
+        auto t = avro_type_of<T>::value;
+        auto& data = cursor.datum->template value<avro::GenericArray>().value();
+        data.resize(n, Datum(item));
+        if (n > 0 && data[0].isUnion()) {
+            for (size_t i = 0; i < n; i++) {
+                _set_type(_Cursor{&data[i], item}, t);
+                data[i].template value<T>() = *values++;
+            }
+            return;
+        }
+        if (_resolve(item)->type() != t) {
             throw AvroError(make_string(
-                                "encountered element of type '", avro::toString(cursor->type()),
+                                "encountered array with elements of type '", avro::toString(_resolve(item)->type()),
                                 "' while type '", avro::toString(t), "' is expected"));
         }
+        for (auto& d : data) {
+            d.template value<T>() = *values++;
+        }
     }
 
-    bool _is_typed_array(Datum const* cursor, avro::Type const& t) const
+    void _check_cursor() const
     {
-        if (cursor->type() != avro::AVRO_ARRAY) {
-            return false;
+        if (!_cursor_stack.empty()) {
+            throw AvroError("`save_cursor` is not balanced out by `restore_cursor`");
         }
-        return _get_array_elem_type(cursor) == t;
     }
+};
 
-    void _assert_array_elem_type(Datum const* cursor, avro::Type const& t) const
+
+struct AvroBlock {
+    // Sequence number of the block in the file, starting at 0.
+    size_t index = 0;
+    // Number of records in the block.
+    size_t object_count = 0;
+    // Serialized records, possibly compressed, inside the memory map
+    // held by the `AvroBlockReader` that produced the block.
+    std::string_view data;
+};
+
+
+class AvroBlockReader
+{
+    // Reads an Avro object container file block by block, without decoding the records.
+    //
+    // The file consists of a header, which holds the schema, the codec, and a 16-byte
+    // sync marker, followed by blocks. Each block is a record count, a byte size,
+    // the (possibly compressed) serialized records, and the sync marker. The sync marker
+    // after every block is verified, so the file is split only at block boundaries.
+    //
+    // The file is memory-mapped; blocks point into the mapping, hence they are valid
+    // as long as the `AvroBlockReader` is alive. If `read_ahead` is `false`, the kernel
+    // is told to not read ahead, so that only the pages holding block headers are read
+    // when the payloads are not looked at.
+
+  public:
+    explicit AvroBlockReader(char const* data_file, bool read_ahead = true)
     {
-        auto tt = _get_array_elem_type(cursor);
-        if (t != tt) {
-            throw AvroError(make_string(
-                                "encountered array with elements of type '", avro::toString(tt),
-                                "' while type '", avro::toString(t), "' is expected"));
+        check_file_exists(data_file);
+        if (read_ahead) {
+            _file = MappedFile(data_file, MADV_SEQUENTIAL);
+            _file.advise(MADV_WILLNEED);
+        } else {
+            _file = MappedFile(data_file, MADV_RANDOM);
+        }
+
+        if (_read_bytes(4) != std::string_view("Obj\x01", 4)) {
+            throw AvroError(make_string("'", data_file, "' is not an Avro object container file"));
+        }
+
+        for (auto n = _read_long(); n != 0; n = _read_long()) {
+            if (n < 0) {
+                n = -n;
+                _read_long(); // byte size of the map block
+            }
+            for (long i = 0; i < n; i++) {
+                auto key = _read_string();
+                _metadata[key] = _read_string();
+            }
+        }
+        _sync = _read_bytes(16);
+
+        if (_metadata.count("avro.schema") == 0) {
+            throw AvroError(make_string("'", data_file, "' does not contain a schema"));
+        }
+        if (_metadata.count("avro.codec") > 0) {
+            _codec = _metadata["avro.codec"];
         }
+        if (_codec != "null" && _codec != "deflate") {
+            throw AvroError(make_string("codec '", _codec, "' is not supported"));
+        }
+        _header_size = _pos;
     }
 
-    template <typename... Names>
-    bool _has_member(Datum const* cursor, std::string const& name, Names&&... names) const
+    size_t file_size() const
     {
-        if constexpr (sizeof...(names) == 0) {
-            if (cursor->type() == avro::AVRO_RECORD) {
-                auto rec = cursor->value<avro::GenericRecord>();
-                return rec.hasField(name);
-            }
-            throw AvroError(make_string(
-                                "'has_member' needs an element of type 'record', but current element has type '",
-                                avro::toString(cursor->type()),
-                                "'"));
-        } else {
-            return _has_member(_cseek(cursor, name), std::forward<Names>(names)...);
+        return _file.size();
+    }
+
+    // Number of bytes in the file header, i.e. offset of the first block.
+    size_t header_size() const
+    {
+        return _header_size;
+    }
+
+    // JSON text of the writer schema.
+    std::string const& schema_json() const
+    {
+        return _metadata.at("avro.schema");
+    }
+
+    avro::ValidSchema schema() const
+    {
+        return avro::compileJsonSchemaFromString(schema_json());
+    }
+
+    // "null" or "deflate".
+    std::string const& codec() const
+    {
+        return _codec;
+    }
+
+    // Read the next block into `block`.
+    // Returns `false` at the end of the file.
+    bool next(AvroBlock& block)
+    {
+        if (_pos == _file.size()) {
+            return false;
         }
+        block.index = _n_blocks++;
+        block.object_count = _read_long();
+        block.data = _read_bytes(_read_long());
+        _check_sync();
+        return true;
     }
 
-    template <typename T>
-    T _get_scalar(Datum const* cursor) const
+    // Restore the serialized records of `block` as written by the writer,
+    // i.e. decompress them if the file uses the deflate codec.
+    // `buffer` is scratch space that may be reused across calls.
+    std::string_view decompress(AvroBlock const& block, std::string& buffer) const
     {
-        if (type_equals<T, std::string>()) {
-            _assert_type(cursor, avro::AVRO_STRING);
-        } else if (type_equals<T, int>()) {
-            _assert_type(cursor, avro::AVRO_INT);
-        } else if (type_equals<T, long>()) {
-            _assert_type(cursor, avro::AVRO_LONG);
-        } else if (type_equals<T, double>()) {
-            _assert_type(cursor, avro::AVRO_DOUBLE);
-        } else if (type_equals<T, float>()) {
-            _assert_type(cursor, avro::AVRO_FLOAT);
-        } else if (type_equals<T, bool>()) {
-            _assert_type(cursor, avro::AVRO_BOOL);
-        } else {
-            throw AvroError("unknown type");
+        if (_codec == "null") {
+            return block.data;
         }
 
-        return cursor->value<T>();
+        z_stream zs{};
+        if (inflateInit2(&zs, -15) != Z_OK) {
+            throw AvroError("failed to initialize zlib");
+        }
+        buffer.resize(std::max<size_t>({buffer.capacity(), block.data.size() * 4, 4096}));
+        zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(block.data.data()));
+        zs.avail_in = block.data.size();
+        size_t n = 0;
+        int status = Z_OK;
+        while (status != Z_STREAM_END) {
+            if (n == buffer.size()) {
+                buffer.resize(buffer.size() * 2);
+            }
+            zs.next_out = reinterpret_cast<Bytef*>(&buffer[n]);
+            zs.avail_out = buffer.size() - n;
+            status = inflate(&zs, Z_NO_FLUSH);
+            n = buffer.size() - zs.avail_out;
+            if (status != Z_OK && status != Z_STREAM_END) {
+                inflateEnd(&zs);
+                throw AvroError(make_string("failed to inflate block ", block.index));
+            }
+        }
+        inflateEnd(&zs);
+        buffer.resize(n);
+        return buffer;
     }
 
-    template <typename T>
-    std::vector<T> _get_vector(Datum const* cursor) const
+  private:
+    MappedFile _file;
+    size_t _pos = 0;
+    std::map<std::string, std::string> _metadata;
+    std::string _codec = "null";
+    std::string_view _sync;
+    size_t _header_size = 0;
+    size_t _n_blocks = 0;
+
+    std::string_view _read_bytes(size_t n)
     {
-        if (cursor->type() != avro::AVRO_ARRAY) {
-            throw AvroError(make_string(
-                                "can not get vector value because current element is not AVRO_ARRAY, ",
-                                "but rather ",
-                                avro::toString(cursor->type())));
+        if (n > _file.size() - _pos) {
+            throw AvroError("unexpected end of Avro file");
         }
+        auto z = std::string_view(_file.data() + _pos, n);
+        _pos += n;
+        return z;
+    }
 
-        if (type_equals<T, std::string>()) {
-            _assert_array_elem_type(cursor, avro::AVRO_STRING);
-        } else if (type_equals<T, int>()) {
-            _assert_array_elem_type(cursor, avro::AVRO_INT);
-        } else if (type_equals<T, long>()) {
-            _assert_array_elem_type(cursor, avro::AVRO_LONG);
-        } else if (type_equals<T, double>()) {
-            _assert_array_elem_type(cursor, avro::AVRO_DOUBLE);
-        } else if (type_equals<T, float>()) {
-            _assert_array_elem_type(cursor, avro::AVRO_FLOAT);
-        } else if (type_equals<T, bool>()) {
-            _assert_array_elem_type(cursor, avro::AVRO_BOOL);
-        } else {
-            throw AvroError("unknown type");
+    long _read_long()
+    {
+        uint64_t n = 0;
+        int shift = 0;
+        int c;
+        do {
+            if (_pos == _file.size()) {
+                throw AvroError("unexpected end of Avro file");
+            }
+            c = static_cast<unsigned char>(_file.data()[_pos++]);
+            if (shift >= 64) {
+                throw AvroError("invalid variable-length integer in Avro file");
+            }
+            n |= static_cast<uint64_t>(c & 0x7f) << shift;
+            shift += 7;
+        } while (c & 0x80);
+        return static_cast<long>((n >> 1) ^ -(n & 1));
+    }
+
+    std::string _read_string()
+    {
+        return std::string(_read_bytes(_read_long()));
+    }
+
+    void _check_sync()
+    {
+        if (_read_bytes(16) != _sync) {
+            throw AvroError(make_string("sync marker mismatch after block ", _n_blocks - 1));
         }
+    }
+};
 
-        auto const& data = cursor->value<avro::GenericArray>().value();
-        std::vector<T> value;
-        value.reserve(_get_array_size(cursor));
-        for (auto const& v : data) {
-            value.push_back(v.value<T>());
+
+struct AvroFileStats {
+    std::string file;
+    // JSON text of the writer schema.
+    std::string schema;
+    std::string codec;
+    size_t file_size = 0;
+    size_t header_size = 0;
+    size_t n_blocks = 0;
+    size_t n_records = 0;
+    // Total size of the serialized, possibly compressed, records in all blocks.
+    size_t data_size = 0;
+};
+
+
+// Statistics of an Avro object container file, gathered from the file header and the
+// block headers only. Block payloads are skipped over without being read or decoded.
+inline AvroFileStats avro_file_stats(std::string const& data_file)
+{
+    AvroBlockReader blocks(data_file.c_str(), false);
+    AvroFileStats z;
+    z.file = data_file;
+    z.schema = blocks.schema_json();
+    z.codec = blocks.codec();
+    z.file_size = blocks.file_size();
+    z.header_size = blocks.header_size();
+    AvroBlock block;
+    while (blocks.next(block)) {
+        z.n_blocks++;
+        z.n_records += block.object_count;
+        z.data_size += block.data.size();
+    }
+    return z;
+}
+
+
+// Statistics of multiple files, scanned on `n_threads` threads (default is the number of cores).
+// The result is in the order of `data_files`.
+inline std::vector<AvroFileStats> avro_file_stats(std::vector<std::string> const& data_files, size_t n_threads = 0)
+{
+    if (n_threads == 0) {
+        n_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    n_threads = std::min(n_threads, data_files.size());
+
+    std::vector<AvroFileStats> z(data_files.size());
+    std::atomic<size_t> next{0};
+    std::mutex mutex;
+    std::exception_ptr error;
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < n_threads; i++) {
+        workers.emplace_back([&] {
+            for (auto k = next++; k < data_files.size(); k = next++) {
+                try {
+                    z[k] = avro_file_stats(data_files[k]);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                }
+            }
+        });
+    }
+    for (auto& t : workers) {
+        t.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return z;
+}
+
+
+// Statistics of all files with extension '.avro' in the directory `dirname`, sorted by file name.
+inline std::vector<AvroFileStats> avro_dir_stats(std::string const& dirname, size_t n_threads = 0)
+{
+    check_dir_exists(dirname);
+    std::vector<std::string> files;
+    for (auto const& entry : std::filesystem::directory_iterator(dirname)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".avro") {
+            files.push_back(entry.path().string());
         }
-        return std::move(value);
     }
+    std::sort(files.begin(), files.end());
+    return avro_file_stats(files, n_threads);
+}
 
-    void _check_cursor() const
+
+class AvroParallelReader
+{
+    // Decodes the blocks of an Avro object container file on multiple threads.
+    //
+    // The calling thread reads the blocks off the file and hands them to worker threads,
+    // which decompress and decode them. Each worker owns an `AvroReader` whose current
+    // record is the record being visited, so the navigation API of `AvroReader`
+    // (including `AvroPath`s made by `make_path` below) works in the callback:
+    //
+    //    AvroParallelReader reader("scores.avro", 8);
+    //    auto score = reader.make_path("score");
+    //    reader.for_each([&](AvroReader& record) {
+    //        auto x = record.get_scalar<double>(score);
+    //    });
+    //
+    // If `ordered` is `true`, the callback is called for one record at a time,
+    // in the order of the records in the file; decoding still runs in parallel.
+    // Otherwise the callback is called concurrently from the worker threads
+    // in no particular order, and must be thread-safe.
+    //
+    // The number of blocks in flight is bounded, so memory use does not grow
+    // with the size of the file.
+
+  public:
+    AvroParallelReader(char const* data_file, size_t n_threads = 0)
+        : _data_file(data_file)
+        , _n_threads(n_threads > 0 ? n_threads : std::max(1u, std::thread::hardware_concurrency()))
     {
-        if (!_cursor_stack.empty()) {
-            throw AvroError("`save_cursor` is not balanced out by `restore_cursor`");
+        _schema = AvroBlockReader(data_file).schema();
+        AvroReader check(_schema); // validates the schema
+    }
+
+    // See `AvroReader::make_path`.
+    template <typename... Names>
+    AvroPath make_path(Names&&... names) const
+    {
+        return AvroReader(_schema).make_path(std::forward<Names>(names)...);
+    }
+
+    // Call `f(AvroReader&)` on every record of the file.
+    template <typename F>
+    void for_each(F f, bool ordered = true)
+    {
+        AvroBlockReader blocks(_data_file.c_str());
+        BlockingQueue<AvroBlock> queue(_n_threads * 2);
+
+        std::mutex mutex;
+        std::condition_variable turn;
+        size_t next_block = 0;
+        bool failed = false;
+        std::exception_ptr error;
+
+        auto fail = [&](std::exception_ptr e) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!failed) {
+                    failed = true;
+                    error = e;
+                }
+            }
+            turn.notify_all();
+            queue.close();
+        };
+
+        auto work = [&]() {
+            try {
+                AvroReader reader(_schema);
+                std::vector<AvroReader::Datum> records;
+                std::string buffer;
+                AvroBlock block;
+                while (queue.pop(block)) {
+                    {
+                        // Blocks left in the queue after a failure are dropped.
+                        std::lock_guard<std::mutex> lock(mutex);
+                        if (failed) {
+                            return;
+                        }
+                    }
+                    auto data = blocks.decompress(block, buffer);
+                    auto in = avro::memoryInputStream(
+                                  reinterpret_cast<uint8_t const*>(data.data()), data.size());
+                    auto decoder = avro::binaryDecoder();
+                    decoder->init(*in);
+
+                    if (!ordered) {
+                        for (size_t i = 0; i < block.object_count; i++) {
+                            avro::decode(*decoder, reader._root);
+                            reader._cursor = &reader._root;
+                            f(reader);
+                            reader._check_cursor();
+                        }
+                        continue;
+                    }
+
+                    while (records.size() < block.object_count) {
+                        records.emplace_back(_schema);
+                    }
+                    for (size_t i = 0; i < block.object_count; i++) {
+                        avro::decode(*decoder, records[i]);
+                    }
+
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        turn.wait(lock, [&] {
+                            return failed || next_block == block.index;
+                        });
+                        if (failed) {
+                            return;
+                        }
+                    }
+                    for (size_t i = 0; i < block.object_count; i++) {
+                        std::swap(reader._root, records[i]);
+                        reader._cursor = &reader._root;
+                        f(reader);
+                        reader._check_cursor();
+                        std::swap(reader._root, records[i]);
+                    }
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        next_block++;
+                    }
+                    turn.notify_all();
+                }
+            } catch (...) {
+                fail(std::current_exception());
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < _n_threads; i++) {
+            workers.emplace_back(work);
+        }
+
+        try {
+            AvroBlock block;
+            while (blocks.next(block)) {
+                if (!queue.push(block)) {
+                    break;
+                }
+            }
+        } catch (...) {
+            fail(std::current_exception());
+        }
+        queue.close();
+
+        for (auto& t : workers) {
+            t.join();
+        }
+        if (error) {
+            std::rethrow_exception(error);
         }
     }
+
+  private:
+    std::string _data_file;
+    size_t _n_threads;
+    avro::ValidSchema _schema;
 };
 
 
@@ -3,12 +3,14 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace zpz
 {
 
 using string = std::string;
+using string_view = std::string_view;
 using size_t = std::size_t;
 
 template <typename T>
@@ -36,7 +36,7 @@ inline bool dir_exists(std::string const & dirname)
 }
 
 
-void check_file_exists(char const * filename)
+inline void check_file_exists(char const * filename)
 {
     if (!file_exists(filename)) {
         throw Error(make_string(
@@ -47,13 +47,13 @@ void check_file_exists(char const * filename)
     }
 }
 
-void check_file_exists(std::string const & filename)
+inline void check_file_exists(std::string const & filename)
 {
     check_file_exists(filename.c_str());
 }
 
 
-void check_dir_exists(char const * dirname)
+inline void check_dir_exists(char const * dirname)
 {
     if (!dir_exists(dirname)) {
         throw Error(make_string(
@@ -65,7 +65,7 @@ void check_dir_exists(char const * dirname)
 }
 
 
-void check_dir_exists(std::string const & dirname)
+inline void check_dir_exists(std::string const & dirname)
 {
     check_dir_exists(dirname.c_str());
 }
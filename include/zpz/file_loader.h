@@ -0,0 +1,602 @@
+#ifndef _zpz_utilities_file_loader_h_
+#define _zpz_utilities_file_loader_h_
+
+#include "exception.h"
+#include "queue.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__) && defined(__NR_io_uring_setup) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define ZPZ_FILE_LOADER_IO_URING 1
+#endif
+
+namespace zpz
+{
+
+class FileLoader
+{
+    // Reads many files concurrently, e.g. the models and vocabularies that a service
+    // loads at startup, so that the total time is bound by the bandwidth of the disk
+    // rather than by the latency of each file:
+    //
+    //    FileLoader loader;
+    //    auto model = loader.load("model.json");
+    //    auto vocab = loader.load("vocab.txt");
+    //    ...
+    //    JsonReader reader(model.get());
+    //
+    // Each file is read into a string of its size. Requests are queued and served
+    // by the loader's threads, hence `load` returns right away; the content arrives
+    // through a future or a callback.
+    //
+    // On Linux the reads go through an io_uring, set up by system calls rather than
+    // liburing. One thread keeps up to 64 reads of up to 4 MiB in flight, over
+    // up to 32 files at a time. If the kernel has no io_uring, or does not permit it
+    // (as in many containers), or `use_io_uring` is `false`, `n_threads` threads
+    // (default is the number of cores) read one file each by `pread`.
+    //
+    // Files that are not regular, or claim to be empty like those in /proc,
+    // are read to the end by `read` either way; with io_uring, on a helper thread,
+    // as opening or reading them may block (think of a FIFO without a writer).
+    // If the ring fails, the files being read through it fail with the error,
+    // and the loader goes on by `pread`.
+    //
+    // The destructor waits for all requests to complete.
+
+  public:
+    // Receives the content of a file, or the error if it could not be read,
+    // on a thread of the loader. It must not throw, and should return quickly,
+    // as other files wait for it.
+    using Callback = std::function<void(std::string&& content, std::exception_ptr error)>;
+
+    explicit FileLoader(size_t n_threads = 0, bool use_io_uring = true)
+        : _jobs(4096)
+        , _side_jobs(4096)
+    {
+#ifdef ZPZ_FILE_LOADER_IO_URING
+        if (use_io_uring && _ring.open(_ring_entries)) {
+            _uses_io_uring = true;
+            _threads.emplace_back([this] {
+                _drive();
+            });
+            _threads.emplace_back([this] {
+                _Job job;
+                while (_side_jobs.pop(job)) {
+                    _run(job);
+                }
+            });
+            return;
+        }
+#else
+        (void)use_io_uring;
+#endif
+        if (n_threads == 0) {
+            n_threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (size_t i = 0; i < n_threads; i++) {
+            _threads.emplace_back([this] {
+                _Job job;
+                while (_jobs.pop(job)) {
+                    _run(job);
+                }
+            });
+        }
+    }
+
+    FileLoader(FileLoader const&) = delete;
+    FileLoader& operator=(FileLoader const&) = delete;
+
+    ~FileLoader()
+    {
+        _jobs.close();
+        for (auto& t : _threads) {
+            t.join();
+        }
+    }
+
+    // Whether the loader was set up with an io_uring.
+    bool uses_io_uring() const
+    {
+        return _uses_io_uring;
+    }
+
+    // Read `filename` in the background and pass the result to `done`.
+    void load(std::string filename, Callback done)
+    {
+        _jobs.push(_Job{std::move(filename), std::move(done)});
+    }
+
+    // Read `filename` in the background. `get` on the result returns the content
+    // or throws the error.
+    std::future<std::string> load(std::string filename)
+    {
+        auto promise = std::make_shared<std::promise<std::string>>();
+        auto z = promise->get_future();
+        load(std::move(filename), [promise](std::string&& content, std::exception_ptr error) {
+            if (error) {
+                promise->set_exception(error);
+            } else {
+                promise->set_value(std::move(content));
+            }
+        });
+        return z;
+    }
+
+    // Read all of `filenames` in the background, in no particular order.
+    std::vector<std::future<std::string>> load_all(std::vector<std::string> const& filenames)
+    {
+        std::vector<std::future<std::string>> z;
+        z.reserve(filenames.size());
+        for (auto const& f : filenames) {
+            z.push_back(load(f));
+        }
+        return z;
+    }
+
+  private:
+    struct _Job {
+        std::string filename;
+        Callback done;
+    };
+
+    BlockingQueue<_Job> _jobs;
+    // Jobs that the ring hands to the helper thread.
+    BlockingQueue<_Job> _side_jobs;
+    std::vector<std::thread> _threads;
+    bool _uses_io_uring = false;
+
+    static constexpr unsigned _ring_entries = 64;
+    static constexpr size_t _max_files = 32;
+    static constexpr size_t _chunk_size = 4 * 1024 * 1024;
+
+    static Error _error(std::string const& action, std::string const& filename, int e)
+    {
+        return Error("could not " + action + " file '" + filename + "': " + std::strerror(e));
+    }
+
+    // Open `filename` and find out whether it is a regular file, and its size.
+    static int _open(std::string const& filename, size_t& size)
+    {
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw _error("open", filename, errno);
+        }
+        struct stat sb;
+        if (::fstat(fd, &sb) != 0) {
+            auto e = errno;
+            ::close(fd);
+            throw _error("stat", filename, e);
+        }
+        size = S_ISREG(sb.st_mode) ? sb.st_size : 0;
+        return fd;
+    }
+
+    // Read `content.size()` bytes from the start of `fd` into `content`, or, if that is 0,
+    // all of `fd` to the end. Returns 0 or `errno`.
+    static int _read(int fd, std::string& content)
+    {
+        bool sized = !content.empty();
+        if (!sized) {
+            content.resize(64 * 1024);
+        }
+        size_t n = 0;
+        while (!sized || n < content.size()) {
+            if (n == content.size()) {
+                content.resize(content.size() * 2);
+            }
+            ssize_t k = sized
+                        ? ::pread(fd, &content[n], content.size() - n, n)
+                        : ::read(fd, &content[n], content.size() - n);
+            if (k < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return errno;
+            }
+            if (k == 0) {
+                break;
+            }
+            n += k;
+        }
+        // A regular file may have been truncated since `fstat`.
+        content.resize(n);
+        return 0;
+    }
+
+    static std::string _read_file(std::string const& filename)
+    {
+        size_t size;
+        int fd = _open(filename, size);
+        std::string content(size, '\0');
+        int e = _read(fd, content);
+        ::close(fd);
+        if (e) {
+            throw _error("read", filename, e);
+        }
+        return content;
+    }
+
+    // Serve `job` on a thread of the pool.
+    static void _run(_Job& job)
+    {
+        std::string content;
+        std::exception_ptr error;
+        try {
+            content = _read_file(job.filename);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        job.done(std::move(content), error);
+    }
+
+#ifdef ZPZ_FILE_LOADER_IO_URING
+    class _Ring
+    {
+        // The submission and completion queues of an io_uring, mapped from the kernel,
+        // with just what reading files takes.
+
+      public:
+        _Ring() = default;
+        _Ring(_Ring const&) = delete;
+        _Ring& operator=(_Ring const&) = delete;
+
+        ~_Ring()
+        {
+            close();
+        }
+
+        // Returns `false` if the kernel does not provide or permit io_uring.
+        bool open(unsigned entries)
+        {
+            io_uring_params p;
+            std::memset(&p, 0, sizeof(p));
+            int fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &p));
+            if (fd < 0) {
+                return false;
+            }
+            _fd = fd;
+            _sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+            _cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+            bool single_map = p.features & IORING_FEAT_SINGLE_MMAP;
+            if (single_map) {
+                _sq_size = _cq_size = std::max(_sq_size, _cq_size);
+            }
+            _sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+            _sq = _map(_sq_size, IORING_OFF_SQ_RING);
+            _cq = single_map ? _sq : _map(_cq_size, IORING_OFF_CQ_RING);
+            _sqes = static_cast<io_uring_sqe*>(_map(_sqes_size, IORING_OFF_SQES));
+            if (!_sq || !_cq || !_sqes) {
+                close();
+                return false;
+            }
+            auto sq = static_cast<char*>(_sq);
+            _sq_head = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+            _sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+            _sq_mask = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+            _sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+            auto cq = static_cast<char*>(_cq);
+            _cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+            _cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+            _cq_mask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+            _cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+            _entries = p.sq_entries;
+            return true;
+        }
+
+        bool is_open() const
+        {
+            return _fd >= 0;
+        }
+
+        unsigned entries() const
+        {
+            return _entries;
+        }
+
+        // Queue a read into `iov` at `offset` of `fd`. The caller keeps no more than
+        // `entries()` reads in flight, hence there is always room, in this queue
+        // and in the completion queue.
+        void read(int fd, iovec const* iov, uint64_t offset, uint64_t user_data)
+        {
+            unsigned tail = *_sq_tail;
+            unsigned index = tail & _sq_mask;
+            io_uring_sqe* sqe = _sqes + index;
+            std::memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_READV;
+            sqe->fd = fd;
+            sqe->off = offset;
+            sqe->addr = reinterpret_cast<uint64_t>(iov);
+            sqe->len = 1;
+            sqe->user_data = user_data;
+            _sq_array[index] = index;
+            __atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+        }
+
+        // Submit the queued reads and wait until at least one read completes.
+        void submit_and_wait()
+        {
+            while (true) {
+                unsigned to_submit = *_sq_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+                if (::syscall(__NR_io_uring_enter, _fd, to_submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0) >= 0) {
+                    return;
+                }
+                if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                    throw Error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+                }
+            }
+        }
+
+        // Call `f(user_data, result)` for each completed read.
+        template <typename F>
+        void reap(F&& f)
+        {
+            unsigned head = *_cq_head;
+            unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+            for (; head != tail; head++) {
+                io_uring_cqe const& cqe = _cqes[head & _cq_mask];
+                f(cqe.user_data, cqe.res);
+            }
+            __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+        }
+
+        // Wait until every read that the kernel has taken from the submission queue
+        // has completed, and drop the results, so that no read uses its buffer any more.
+        // Throws if waiting fails.
+        void drain()
+        {
+            while (true) {
+                reap([](uint64_t, int) {
+                });
+                // Both heads count from 0 since the ring was set up.
+                unsigned n = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) - *_cq_head;
+                if (n == 0) {
+                    return;
+                }
+                if (::syscall(__NR_io_uring_enter, _fd, 0, n, IORING_ENTER_GETEVENTS, nullptr, 0) < 0
+                        && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                    throw Error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+                }
+            }
+        }
+
+        void close()
+        {
+            if (_sqes) {
+                ::munmap(_sqes, _sqes_size);
+            }
+            if (_cq && _cq != _sq) {
+                ::munmap(_cq, _cq_size);
+            }
+            if (_sq) {
+                ::munmap(_sq, _sq_size);
+            }
+            if (_fd >= 0) {
+                ::close(_fd);
+            }
+            _sqes = nullptr;
+            _cq = nullptr;
+            _sq = nullptr;
+            _fd = -1;
+        }
+
+      private:
+        int _fd = -1;
+        unsigned _entries = 0;
+        void* _sq = nullptr;
+        void* _cq = nullptr;
+        io_uring_sqe* _sqes = nullptr;
+        size_t _sq_size = 0;
+        size_t _cq_size = 0;
+        size_t _sqes_size = 0;
+        unsigned* _sq_head = nullptr;
+        unsigned* _sq_tail = nullptr;
+        unsigned _sq_mask = 0;
+        unsigned* _sq_array = nullptr;
+        unsigned* _cq_head = nullptr;
+        unsigned* _cq_tail = nullptr;
+        unsigned _cq_mask = 0;
+        io_uring_cqe* _cqes = nullptr;
+
+        void* _map(size_t size, off_t offset)
+        {
+            void* addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, offset);
+            return addr == MAP_FAILED ? nullptr : addr;
+        }
+    };
+
+    // A file being read through the ring.
+    struct _File {
+        _Job job;
+        int fd;
+        std::string content;
+        // Offset of the next chunk to queue.
+        size_t next = 0;
+        // Number of chunks in flight.
+        size_t pending = 0;
+        int error = 0;
+    };
+
+    // A read in flight; its index in `chunks` of `_drive` is the `user_data` of the read.
+    struct _Chunk {
+        _File* file;
+        uint64_t offset;
+        iovec iov;
+    };
+
+    _Ring _ring;
+
+    void _drive()
+    {
+        std::vector<std::unique_ptr<_File>> files;
+        std::vector<_Chunk> chunks(_ring.entries());
+        try {
+            _drive_ring(files, chunks);
+        } catch (...) {
+            // The ring failed. Its files fail with the error, once the reads in flight,
+            // which write into the files and read their `iovec`s from `chunks`, have completed.
+            // Closing the ring would not do, as the kernel cancels them in the background.
+            // If even waiting for them fails, the memory they use is leaked to them.
+            // The requests that follow are served by `pread` on this thread.
+            auto error = std::current_exception();
+            bool drained = true;
+            try {
+                _ring.drain();
+            } catch (...) {
+                drained = false;
+            }
+            _ring.close();
+            for (auto& f : files) {
+                ::close(f->fd);
+                f->job.done(std::string(), error);
+                if (!drained) {
+                    f.release();
+                }
+            }
+            if (!drained) {
+                new std::vector<_Chunk>(std::move(chunks));
+            }
+            _Job job;
+            while (_jobs.pop(job)) {
+                _run(job);
+            }
+        }
+        _side_jobs.close();
+    }
+
+    // Serve the jobs through the ring until the loader closes, with a slot in `chunks`
+    // for each read in flight. Throws if the ring fails, leaving the files that are being
+    // read in `files`.
+    void _drive_ring(std::vector<std::unique_ptr<_File>>& files, std::vector<_Chunk>& chunks)
+    {
+        std::vector<uint64_t> free_slots;
+        for (size_t i = chunks.size(); i > 0; i--) {
+            free_slots.push_back(i - 1);
+        }
+        _Job job;
+        while (true) {
+            if (files.empty()) {
+                // Idle; wait for work.
+                if (!_jobs.pop(job)) {
+                    break;
+                }
+                _start(job, files);
+            }
+            while (files.size() < _max_files && _jobs.try_pop(job)) {
+                _start(job, files);
+            }
+
+            for (auto& f : files) {
+                while (!f->error && f->next < f->content.size() && !free_slots.empty()) {
+                    auto slot = free_slots.back();
+                    free_slots.pop_back();
+                    size_t n = std::min(_chunk_size, f->content.size() - f->next);
+                    chunks[slot] = _Chunk{f.get(), f->next, iovec{&f->content[f->next], n}};
+                    _ring.read(f->fd, &chunks[slot].iov, f->next, slot);
+                    f->next += n;
+                    f->pending++;
+                }
+            }
+
+            if (free_slots.size() < chunks.size()) {
+                _ring.submit_and_wait();
+                _ring.reap([&](uint64_t slot, int result) {
+                    auto& c = chunks[slot];
+                    _File* f = c.file;
+                    if (result < 0) {
+                        f->error = -result;
+                    } else if (result == 0) {
+                        // Truncated since `fstat`.
+                        f->error = EIO;
+                    } else if (static_cast<size_t>(result) < c.iov.iov_len) {
+                        // A short read; read the rest.
+                        c.offset += result;
+                        c.iov.iov_base = static_cast<char*>(c.iov.iov_base) + result;
+                        c.iov.iov_len -= result;
+                        _ring.read(f->fd, &c.iov, c.offset, slot);
+                        return;
+                    }
+                    f->pending--;
+                    free_slots.push_back(slot);
+                });
+            }
+
+            files.erase(
+                std::remove_if(files.begin(), files.end(), [](std::unique_ptr<_File>& f) {
+                    if (f->pending > 0 || (!f->error && f->next < f->content.size())) {
+                        return false;
+                    }
+                    ::close(f->fd);
+                    if (f->error) {
+                        f->job.done(std::string(), std::make_exception_ptr(_error("read", f->job.filename, f->error)));
+                    } else {
+                        f->job.done(std::move(f->content), nullptr);
+                    }
+                    return true;
+                }),
+                files.end());
+        }
+    }
+
+    // Open the file of `job` and add it to `files`, unless it is not a non-empty regular
+    // file, which goes to the helper thread (as do errors of `stat`), or it can not be opened.
+    void _start(_Job& job, std::vector<std::unique_ptr<_File>>& files)
+    {
+        struct stat sb;
+        if (::stat(job.filename.c_str(), &sb) != 0 || !S_ISREG(sb.st_mode) || sb.st_size == 0) {
+            _side_jobs.push(std::move(job));
+            return;
+        }
+        size_t size;
+        int fd;
+        try {
+            fd = _open(job.filename, size);
+        } catch (...) {
+            job.done(std::string(), std::current_exception());
+            return;
+        }
+        if (size == 0) {
+            // Replaced since `stat`.
+            ::close(fd);
+            _side_jobs.push(std::move(job));
+            return;
+        }
+        files.emplace_back(new _File{std::move(job), fd, std::string(size, '\0')});
+    }
+#endif
+};
+
+
+// Read all of `filenames` concurrently by a `FileLoader`. The result is in the order
+// of `filenames`. Throws the error of the first file, in this order, that could not be read.
+inline std::vector<std::string> read_files(std::vector<std::string> const& filenames, size_t n_threads = 0)
+{
+    FileLoader loader(n_threads);
+    auto futures = loader.load_all(filenames);
+    std::vector<std::string> z;
+    z.reserve(futures.size());
+    for (auto& f : futures) {
+        z.push_back(f.get());
+    }
+    return z;
+}
+
+} // namespace zpz
+#endif // _zpz_utilities_file_loader_h_
@@ -0,0 +1,337 @@
+#ifndef _zpz_utilities_gzip_h_
+#define _zpz_utilities_gzip_h_
+
+#include "exception.h"
+#include "mapped_file.h"
+#include "queue.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace zpz
+{
+
+// Whether `data` starts like a gzip stream.
+inline bool is_gzip(std::string_view data)
+{
+    return data.size() >= 2 && static_cast<unsigned char>(data[0]) == 0x1f
+           && static_cast<unsigned char>(data[1]) == 0x8b;
+}
+
+
+class GzipReader
+{
+    // Decompresses a gzip file as a stream, one chunk at a time:
+    //
+    //    GzipReader in("events.json.gz");
+    //    std::string_view chunk;
+    //    while (in.next(chunk)) {
+    //        ...
+    //    }
+    //
+    // The compressed file is memory-mapped; the output goes into a few buffers
+    // of `chunk_size` bytes, which are reused, so memory use does not depend
+    // on the size of the file. Files of concatenated gzip streams, as written by
+    // `cat a.gz b.gz` or parallel compressors, are read as one. zlib streams
+    // are accepted as well.
+    //
+    // If `threaded` is `true`, a thread decompresses ahead, up to three chunks,
+    // while the caller consumes the previous one. Decompression is usually slower
+    // than parsing, hence this lets both run at the same time.
+    //
+    // Either `next` or `read` is to be used on a reader, not both.
+
+  public:
+    explicit GzipReader(MappedFile file, bool threaded = false, size_t chunk_size = 1024 * 1024)
+        : _file(std::move(file))
+        , _chunk_size(std::max<size_t>(chunk_size, 4096))
+        , _free(_n_buffers)
+        , _filled(_n_buffers)
+    {
+        std::memset(&_zs, 0, sizeof(_zs));
+        // 15 + 32: any window size, gzip or zlib header.
+        if (inflateInit2(&_zs, 15 + 32) != Z_OK) {
+            throw Error("failed to initialize zlib");
+        }
+        if (threaded) {
+            for (size_t i = 0; i < _n_buffers; i++) {
+                _free.push(_Chunk{std::unique_ptr<char[]>(new char[_chunk_size]), 0});
+            }
+            _thread = std::thread([this] {
+                _decompress_ahead();
+            });
+        } else {
+            _current.data.reset(new char[_chunk_size]);
+        }
+    }
+
+    explicit GzipReader(std::string const& filename, bool threaded = false, size_t chunk_size = 1024 * 1024)
+        : GzipReader(MappedFile(filename, MADV_SEQUENTIAL), threaded, chunk_size)
+    {
+    }
+
+    GzipReader(GzipReader const&) = delete;
+    GzipReader& operator=(GzipReader const&) = delete;
+
+    ~GzipReader()
+    {
+        if (_thread.joinable()) {
+            _free.close();
+            _filled.close();
+            _thread.join();
+        }
+        inflateEnd(&_zs);
+    }
+
+    // The next chunk of decompressed data, valid until the next call.
+    // Returns `false` at the end.
+    bool next(std::string_view& chunk)
+    {
+        if (_thread.joinable()) {
+            if (_current.data) {
+                _free.push(std::move(_current));
+            }
+            if (!_filled.pop(_current)) {
+                _current = _Chunk();
+                if (_error) {
+                    std::rethrow_exception(_error);
+                }
+                return false;
+            }
+        } else {
+            _current.size = _inflate(_current.data.get(), _chunk_size);
+            if (_current.size == 0) {
+                return false;
+            }
+        }
+        chunk = std::string_view(_current.data.get(), _current.size);
+        return true;
+    }
+
+    // Decompress up to `size` bytes into `buffer`, and return their number;
+    // 0 at the end. Without a thread, this decompresses right into `buffer`.
+    size_t read(char* buffer, size_t size)
+    {
+        if (!_thread.joinable()) {
+            return _inflate(buffer, size);
+        }
+        if (_rest.empty() && !next(_rest)) {
+            return 0;
+        }
+        size_t n = std::min(size, _rest.size());
+        std::memcpy(buffer, _rest.data(), n);
+        _rest.remove_prefix(n);
+        return n;
+    }
+
+    // The decompressed size as recorded at the end of the file. This is modulo 4 GiB,
+    // and of the last stream only, if there are multiple; hence a hint.
+    size_t size_hint() const
+    {
+        if (_file.size() < 18) {
+            return 0;
+        }
+        auto p = reinterpret_cast<unsigned char const*>(_file.data() + _file.size() - 4);
+        return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<size_t>(p[3]) << 24);
+    }
+
+  private:
+    struct _Chunk {
+        std::unique_ptr<char[]> data;
+        size_t size = 0;
+    };
+
+    static constexpr size_t _n_buffers = 4;
+
+    MappedFile _file;
+    size_t _chunk_size;
+    z_stream _zs;
+    size_t _in_pos = 0;
+    bool _done = false;
+
+    _Chunk _current;
+    std::string_view _rest;
+    BlockingQueue<_Chunk> _free;
+    BlockingQueue<_Chunk> _filled;
+    std::thread _thread;
+    std::exception_ptr _error;
+
+    // Decompress into `out` until it is full or the input ends.
+    size_t _inflate(char* out, size_t size)
+    {
+        _zs.next_out = reinterpret_cast<Bytef*>(out);
+        _zs.avail_out = static_cast<uInt>(std::min<size_t>(size, 1u << 30));
+        size_t capacity = _zs.avail_out;
+        while (_zs.avail_out > 0 && !_done) {
+            if (_zs.avail_in == 0) {
+                if (_in_pos == _file.size()) {
+                    throw Error("failed to decompress: unexpected end of gzip data");
+                }
+                // `avail_in` is 32-bit; feed large files in pieces.
+                size_t n = std::min<size_t>(_file.size() - _in_pos, 1u << 30);
+                _zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(_file.data() + _in_pos));
+                _zs.avail_in = static_cast<uInt>(n);
+                _in_pos += n;
+            }
+            int status = inflate(&_zs, Z_NO_FLUSH);
+            if (status == Z_STREAM_END) {
+                if (_zs.avail_in == 0 && _in_pos == _file.size()) {
+                    _done = true;
+                } else {
+                    // Another stream follows.
+                    inflateReset(&_zs);
+                }
+            } else if (status != Z_OK) {
+                throw Error(std::string("failed to decompress: ") + (_zs.msg ? _zs.msg : zError(status)));
+            }
+        }
+        return capacity - _zs.avail_out;
+    }
+
+    void _decompress_ahead()
+    {
+        try {
+            _Chunk chunk;
+            while (_free.pop(chunk)) {
+                chunk.size = _inflate(chunk.data.get(), _chunk_size);
+                if (chunk.size == 0 || !_filled.push(std::move(chunk))) {
+                    break;
+                }
+            }
+        } catch (...) {
+            _error = std::current_exception();
+        }
+        _filled.close();
+    }
+};
+
+
+// A rapidjson input stream over a `GzipReader`, e.g.
+//
+//    GzipReader in("doc.json.gz", true);
+//    GzipStream stream(in);
+//    document.ParseStream(stream);
+//
+// so that the document is parsed as it is decompressed, without holding all the text.
+class GzipStream
+{
+  public:
+    using Ch = char;
+
+    explicit GzipStream(GzipReader& reader)
+        : _reader(reader)
+    {
+    }
+
+    Ch Peek()
+    {
+        if (_pos == _chunk.size() && !_next()) {
+            return '\0';
+        }
+        return _chunk[_pos];
+    }
+
+    Ch Take()
+    {
+        Ch c = Peek();
+        if (_pos < _chunk.size()) {
+            _pos++;
+        }
+        return c;
+    }
+
+    size_t Tell() const
+    {
+        return _offset + _pos;
+    }
+
+    // Only for output streams.
+    Ch* PutBegin()
+    {
+        assert(false);
+        return nullptr;
+    }
+    void Put(Ch)
+    {
+        assert(false);
+    }
+    void Flush()
+    {
+        assert(false);
+    }
+    size_t PutEnd(Ch*)
+    {
+        assert(false);
+        return 0;
+    }
+
+  private:
+    GzipReader& _reader;
+    std::string_view _chunk;
+    size_t _pos = 0;
+    size_t _offset = 0;
+
+    bool _next()
+    {
+        _offset += _chunk.size();
+        _pos = 0;
+        if (!_reader.next(_chunk)) {
+            _chunk = std::string_view();
+            return false;
+        }
+        return true;
+    }
+};
+
+
+// Decompress all of `file` into a string.
+inline std::string read_gzip(MappedFile file)
+{
+    // One byte more than the recorded size, so that the last read finds the end
+    // without growing the string. The recorded size is not to be trusted that far,
+    // though; text rarely compresses by more than 16 times, and if it does,
+    // the string grows as needed.
+    size_t limit = file.size() * 16;
+    GzipReader in(std::move(file));
+    std::string z(std::max<size_t>(std::min(in.size_hint(), limit) + 1, 4096), '\0');
+    size_t n = 0;
+    while (true) {
+        if (n == z.size()) {
+            z.resize(z.size() * 2);
+        }
+        size_t k = in.read(&z[n], z.size() - n);
+        if (k == 0) {
+            break;
+        }
+        n += k;
+    }
+    z.resize(n);
+    return z;
+}
+
+inline std::string read_gzip_file(std::string const& filename)
+{
+    return read_gzip(MappedFile(filename, MADV_SEQUENTIAL, false, true));
+}
+
+// Like `read_text_file` in io.h, except that a gzip-compressed file is decompressed,
+// straight from the map into the string.
+inline std::string read_text_or_gzip_file(std::string const& filename)
+{
+    MappedFile f(filename, MADV_SEQUENTIAL, false, true);
+    if (is_gzip(f.view())) {
+        return read_gzip(std::move(f));
+    }
+    return std::string(f.view());
+}
+
+} // namespace zpz
+#endif // _zpz_utilities_gzip_h_
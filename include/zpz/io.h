@@ -1,6 +1,8 @@
 #ifndef _zpz_utilities_io_h_
 #define _zpz_utilities_io_h_
 
+#include "mapped_file.h"
+
 #include <fstream>
 #include <iostream>
 #include <map>
@@ -47,6 +49,7 @@ std::ostream& operator<<(std::ostream& os, std::map<K, V> const& x)
             os << ", ";
         }
         os << '"' << k << "\": \"" << v << "\"";
+        n++;
     }
     os << "}";
     return os;
@@ -62,25 +65,26 @@ std::ostream& operator<<(std::ostream& os, std::unordered_map<K, V> const& x)
             os << ", ";
         }
         os << '"' << k << "\": \"" << v << "\"";
+        n++;
     }
     os << "}";
     return os;
 }
 
-std::string read_text_file(std::string const& filename)
+// Read the whole file into a string. The file is mapped with `MAP_POPULATE` and copied
+// into the string once, which is allocated at its final size. Throws if the file
+// can not be read.
+inline std::string read_binary_file(std::string const& filename)
 {
-    std::ifstream f(filename);
-    std::ostringstream ss;
-    ss << f.rdbuf();
-    return ss.str();
+    MappedFile f(filename, MADV_SEQUENTIAL, false, true);
+    return std::string(f.view());
 }
 
-std::string read_binary_file(std::string const& filename)
+// On POSIX systems text and binary files are read alike.
+// To decompress gzip files as well, see `read_text_or_gzip_file` in gzip.h.
+inline std::string read_text_file(std::string const& filename)
 {
-    auto text = read_text_file(filename);
-    // auto v = std::vector<char>(text.begin(), text.end());
-    // return std::string(v.cbegin(), v.cend());
-    return text;
+    return read_binary_file(filename);
 }
 
 } // namespace zpz
@@ -1,15 +1,380 @@
 #ifndef _zpz_utilities_json_h_
 #define _zpz_utilities_json_h_
 
+#include "common.h"
 #include "exception.h"
+#include "file.h"
+#include "gzip.h"
+#include "json_simd.h"
+#include "mapped_file.h"
+#include "murmurhash3.h"
+#include "queue.h"
 #include "string.h"
 #include "typing.h"
 
 #include <rapidjson/document.h>
+#include <rapidjson/error/en.h>
+#include <rapidjson/memorystream.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 
 namespace zpz
 {
 
+// Type check, name, and getter of a scalar JSON value that is read into the C++ type `T`;
+// not defined for unsupported types.
+template <typename T>
+struct json_type_of;
+
+template <>
+struct json_type_of<string> {
+    static constexpr char const* name = "string";
+    static bool check(rapidjson::Value const& v)
+    {
+        return v.IsString();
+    }
+    static string get(rapidjson::Value const& v)
+    {
+        return string(v.GetString(), v.GetStringLength());
+    }
+};
+
+template <>
+struct json_type_of<int> {
+    static constexpr char const* name = "int";
+    static bool check(rapidjson::Value const& v)
+    {
+        return v.IsInt();
+    }
+    static int get(rapidjson::Value const& v)
+    {
+        return v.GetInt();
+    }
+};
+
+template <>
+struct json_type_of<unsigned> {
+    static constexpr char const* name = "uint";
+    static bool check(rapidjson::Value const& v)
+    {
+        return v.IsUint();
+    }
+    static unsigned get(rapidjson::Value const& v)
+    {
+        return v.GetUint();
+    }
+};
+
+template <>
+struct json_type_of<long> {
+    static constexpr char const* name = "long";
+    static bool check(rapidjson::Value const& v)
+    {
+        return v.IsInt64();
+    }
+    static long get(rapidjson::Value const& v)
+    {
+        return v.GetInt64();
+    }
+};
+
+template <>
+struct json_type_of<double> {
+    static constexpr char const* name = "double";
+    static bool check(rapidjson::Value const& v)
+    {
+        return v.IsDouble();
+    }
+    static double get(rapidjson::Value const& v)
+    {
+        return v.GetDouble();
+    }
+};
+
+template <>
+struct json_type_of<float> {
+    static constexpr char const* name = "float";
+    static bool check(rapidjson::Value const& v)
+    {
+        return v.IsFloat();
+    }
+    static float get(rapidjson::Value const& v)
+    {
+        return v.GetFloat();
+    }
+};
+
+template <>
+struct json_type_of<bool> {
+    static constexpr char const* name = "bool";
+    static bool check(rapidjson::Value const& v)
+    {
+        return v.IsBool();
+    }
+    static bool get(rapidjson::Value const& v)
+    {
+        return v.GetBool();
+    }
+};
+
+
+class JsonMemberIndex
+{
+    // Hash table from member names of a JSON object to the members,
+    // for constant-time lookup in objects with many members.
+    //
+    // The table uses open addressing with linear probing over murmur hashes of the names.
+    // Each slot holds the hash and the position of the member, so that names are compared
+    // only when the hashes match. If a name occurs more than once, the first member wins,
+    // as in rapidjson's `FindMember`.
+    //
+    // The index refers to the object, which must not be modified while the index is in use.
+
+  public:
+    using JsonValue = rapidjson::Value;
+
+    explicit JsonMemberIndex(JsonValue const& obj)
+        : _obj(&obj)
+    {
+        size_t n = obj.MemberCount();
+        size_t cap = 16;
+        while (cap < n * 2) {
+            cap *= 2;
+        }
+        _mask = cap - 1;
+        _slots.resize(cap);
+
+        auto begin = obj.MemberBegin();
+        for (size_t i = 0; i < n; i++) {
+            auto const& key = begin[i].name;
+            auto h = _hash(key.GetString(), key.GetStringLength());
+            auto k = h & _mask;
+            while (true) {
+                auto& slot = _slots[k];
+                if (slot.pos == 0) {
+                    slot.hash = h;
+                    slot.pos = i + 1;
+                    break;
+                }
+                if (slot.hash == h && _equals(slot.pos - 1, key.GetString(), key.GetStringLength())) {
+                    break;
+                }
+                k = (k + 1) & _mask;
+            }
+        }
+    }
+
+    // The value of the member named `name`, or null if there is no such member.
+    JsonValue const* find(char const* name, size_t len) const
+    {
+        auto h = _hash(name, len);
+        auto k = h & _mask;
+        while (true) {
+            auto const& slot = _slots[k];
+            if (slot.pos == 0) {
+                return nullptr;
+            }
+            if (slot.hash == h && _equals(slot.pos - 1, name, len)) {
+                return &_obj->MemberBegin()[slot.pos - 1].value;
+            }
+            k = (k + 1) & _mask;
+        }
+    }
+
+  private:
+    struct Slot {
+        uint32_t hash = 0;
+        // Position of the member plus 1; 0 for an empty slot.
+        uint32_t pos = 0;
+    };
+
+    JsonValue const* _obj;
+    std::vector<Slot> _slots;
+    size_t _mask;
+
+    static uint32_t _hash(char const* name, size_t len)
+    {
+        uint32_t h;
+        MurmurHash3_x86_32(name, static_cast<int>(len), 0, &h);
+        return h;
+    }
+
+    bool _equals(size_t pos, char const* name, size_t len) const
+    {
+        auto const& key = _obj->MemberBegin()[pos].name;
+        return key.GetStringLength() == len && std::memcmp(key.GetString(), name, len) == 0;
+    }
+};
+
+
+class JsonPath
+{
+    // A sequence of member names and array indices, like the arguments of
+    // `JsonReader::seek`, e.g.
+    //
+    //    JsonPath{"layers", 0, "weights"}
+
+  public:
+    struct Step {
+        Step(char const* name)
+            : name(name)
+        {
+        }
+
+        Step(string name)
+            : name(std::move(name))
+        {
+        }
+
+        Step(size_t index)
+            : index(index)
+            , is_index(true)
+        {
+        }
+
+        // So that integer literals work.
+        Step(int index)
+            : index(static_cast<size_t>(index))
+            , is_index(true)
+        {
+            if (index < 0) {
+                throw Error(make_string("invalid array index ", index, " in JSON path"));
+            }
+        }
+
+        string name;
+        size_t index = 0;
+        bool is_index = false;
+    };
+
+    JsonPath(std::initializer_list<Step> steps)
+        : _steps(steps)
+    {
+    }
+
+    vector<Step> const& steps() const
+    {
+        return _steps;
+    }
+
+  private:
+    vector<Step> _steps;
+};
+
+
+class JsonPathTrie
+{
+    // Paths merged by common prefixes, so that a shared prefix is walked only once.
+    // Each path is numbered by a "slot"; the node where a path ends lists its slot.
+    //
+    // As in `JsonReader::seek`, a step named "/" goes to the root of the document;
+    // the rest of the path then hangs off `document_root` rather than `root`.
+
+  public:
+    struct Node {
+        vector<size_t> slots;
+        vector<std::pair<string, std::unique_ptr<Node>>> members;
+        vector<std::pair<size_t, std::unique_ptr<Node>>> items;
+    };
+
+    void add(JsonPath const& path, size_t slot)
+    {
+        Node* node = &_root;
+        for (auto const& step : path.steps()) {
+            if (step.is_index) {
+                node = _child(node->items, step.index);
+            } else if (step.name == "/") {
+                node = &_document_root;
+            } else if (step.name == "") {
+                throw Error("can not seek an element with empty name");
+            } else {
+                node = _child(node->members, step.name);
+            }
+        }
+        node->slots.push_back(slot);
+    }
+
+    // Paths relative to the cursor.
+    Node const& root() const
+    {
+        return _root;
+    }
+
+    // Paths relative to the root of the document.
+    Node const& document_root() const
+    {
+        return _document_root;
+    }
+
+  private:
+    Node _root;
+    Node _document_root;
+
+    template <typename K>
+    static Node* _child(vector<std::pair<K, std::unique_ptr<Node>>>& children, K const& key)
+    {
+        for (auto& child : children) {
+            if (child.first == key) {
+                return child.second.get();
+            }
+        }
+        children.emplace_back(key, new Node());
+        return children.back().second.get();
+    }
+};
+
+
+template <typename... Ts>
+class JsonQuery
+{
+    // Values of types `Ts...` at a fixed set of paths, resolved together by
+    // `JsonReader::query` in one traversal that visits each shared object once:
+    //
+    //    JsonQuery<int, string, vector<double>> q{
+    //        {"model", "dim"},
+    //        {"model", "name"},
+    //        {"model", "bias"}};
+    //    auto [dim, name, bias] = reader.query(q);
+    //
+    // Each type is one of the types of `get_scalar`, or a `vector` of one as in `get_vector`.
+    // The paths are relative to the cursor of the reader, unless they pass through "/".
+    // A query is meant to be built once and run on many documents.
+
+  public:
+    JsonQuery(std::initializer_list<JsonPath> paths)
+    {
+        if (paths.size() != sizeof...(Ts)) {
+            throw Error(make_string(
+                            "JsonQuery of ", sizeof...(Ts), " types is given ", paths.size(), " paths"));
+        }
+        size_t slot = 0;
+        for (auto const& path : paths) {
+            _trie.add(path, slot++);
+        }
+    }
+
+    JsonPathTrie const& trie() const
+    {
+        return _trie;
+    }
+
+  private:
+    JsonPathTrie _trie;
+};
+
+
 class JsonReader
 {
     // Design of this class is similar to that of `AvroReader`.
@@ -17,26 +382,224 @@ class JsonReader
     // This class is not optimized for speed.
 
   public:
-    using JsonDoc = rapidjson::Document;
+    using Allocator = rapidjson::MemoryPoolAllocator<>;
+    using JsonDoc = rapidjson::GenericDocument<rapidjson::UTF8<>, Allocator, Allocator>;
     using JsonValue = rapidjson::Value;
     using Cursor = JsonValue const*;
 
-    JsonReader(string json)
+    // Tag to select in-situ parsing of a file; see the constructor that takes it.
+    struct InSitu {
+    };
+
+    // Sizes of the memory that a reader allocates up front.
+    //
+    // The document is built in an arena, and parsing uses a stack. Both start out in
+    // blocks of the sizes given here, which are kept across `reset`s. If a document
+    // needs more, the arena grows by blocks of `chunk_size`, which are released
+    // at the next `reset`. Hence, if the initial blocks are large enough for the typical
+    // document, parsing one document after another does not allocate at all.
+    struct ArenaOptions {
+        size_t initial_size = 64 * 1024;
+        size_t chunk_size = 64 * 1024;
+        size_t stack_size = 4 * 1024;
+    };
+
+    // Parser that builds the document.
+    //
+    // `simd` uses `JsonSimdParser`, which locates the structure of the text
+    // with SIMD instructions before building the document. It falls back to rapidjson
+    // if the CPU has no SIMD support or the text is 4 GiB or larger.
+    //
+    // `lazy` parses one level at a time. Arrays and objects nested in the value
+    // being parsed are skipped by bracket matching and left as null placeholders,
+    // which are parsed when `seek`, `get_*` and the like first step into them.
+    // Time and memory then scale with the part of the document that is visited,
+    // not with its size. The reader keeps a copy of the text. Parts that are not visited
+    // are not validated. Because reading may parse, a lazy reader must not be used
+    // by multiple threads at once, even through `const` methods.
+    //
+    // `parallel` is for a large top-level array, e.g. one object per record.
+    // `JsonStructuralIndex::split_array` cuts the array between elements into one run
+    // per thread, which is told apart from commas in strings and nested values
+    // by the same bit arithmetic as stage 1 of `simd`. The runs are parsed concurrently
+    // by rapidjson, element by element in place in the text, each into an arena of its own
+    // that lives as long as the document, and their elements are moved into the root array.
+    // The result, including the offset of an error, is the same as with `rapidjson`. Other documents, and those shorter than 1 MiB, are parsed
+    // by rapidjson on the calling thread. See `set_threads`.
+    //
+    // In-situ parsing always uses rapidjson.
+    enum class Backend {
+        rapidjson,
+        simd,
+        lazy,
+        parallel
+    };
+
+    // A reader without a document (its root is null) to be filled by `reset`.
+    // This is meant to be kept around, e.g. one per thread, to parse many documents
+    // one after another, such as the payloads of requests:
+    //
+    //    JsonReader reader(JsonReader::ArenaOptions{1 << 20});
+    //    for (...) {
+    //        reader.reset(payload);
+    //        ...
+    //    }
+    explicit JsonReader(ArenaOptions const& options)
+        : _arena_size(std::max<size_t>(options.initial_size, 1024) + _pool_overhead)
+        , _stack_size(std::max<size_t>(options.stack_size, 1024))
+        , _stack_arena_size(_stack_size + _reader_stack_size + _pool_overhead)
+        , _chunk_size(options.chunk_size)
+        , _arena(new char[_arena_size])
+        , _stack_arena(new char[_stack_arena_size])
+        , _allocator(_arena.get(), _arena_size, options.chunk_size)
+        , _stack_allocator(_stack_arena.get(), _stack_arena_size, options.chunk_size)
+        , _root(&_allocator, _stack_size, &_stack_allocator)
     {
-        _root.Parse(json.c_str());
         _cursor = &_root;
     }
 
+    // The document and the arenas refer to each other.
+    JsonReader(JsonReader const&) = delete;
+    JsonReader& operator=(JsonReader const&) = delete;
+    JsonReader(JsonReader&&) = delete;
+    JsonReader& operator=(JsonReader&&) = delete;
+
+    JsonReader(string json)
+        : JsonReader(ArenaOptions())
+    {
+        reset(json);
+    }
+
+    // A gzip-compressed file is parsed while it is decompressed on another thread
+    // (see `GzipStream`), without holding all of the text.
     JsonReader(char const* filename)
-        : JsonReader(read_text_file(filename))
+        : JsonReader(ArenaOptions())
+    {
+        MappedFile file(filename, MADV_SEQUENTIAL, false, true);
+        if (is_gzip(file.view())) {
+            GzipReader in(std::move(file), true);
+            GzipStream stream(in);
+            _root.ParseStream(stream);
+            _check_parse();
+        } else {
+            reset(file.view());
+        }
+    }
+
+    JsonReader(string json, Backend backend)
+        : JsonReader(ArenaOptions())
+    {
+        _backend = backend;
+        if (backend == Backend::lazy) {
+            // Keep the text without copying it.
+            _text = std::move(json);
+            reset(_text);
+        } else {
+            reset(json);
+        }
+    }
+
+    // A gzip-compressed file is decompressed in full before it is parsed.
+    JsonReader(char const* filename, Backend backend)
+        : JsonReader(read_text_or_gzip_file(filename), backend)
     {
     }
 
+    // Parse the file in place, e.g.
+    //
+    //    JsonReader reader("vocab.json", JsonReader::InSitu());
+    //
+    // The file is memory-mapped copy-on-write, and parsed in the mapped buffer
+    // by rapidjson's in-situ parsing. Strings in the document point into the buffer
+    // instead of being copied; only the pages that the parser modifies are copied
+    // by the kernel. The buffer lives as long as the reader.
+    JsonReader(char const* filename, InSitu)
+        : JsonReader(ArenaOptions())
+    {
+        _buffer = MappedFile(filename, MADV_SEQUENTIAL, true);
+        _root.ParseInsitu(_buffer.mutable_data());
+        _check_parse();
+    }
+
     ~JsonReader()
     {
         _check_cursor();
     }
 
+    // Replace the document by the one parsed from `json`, reusing the memory
+    // of the previous document. The cursor is reset to the root.
+    void reset(string_view json)
+    {
+        _check_cursor();
+        _cursor = &_root;
+        _member_indices.clear();
+        _placeholders.clear();
+        _root.SetNull();
+        _buffer = MappedFile();
+        _allocator.Clear();
+        _run_allocators.clear();
+        _stack_allocator.Clear();
+        if (_backend == Backend::lazy) {
+            if (json.data() != _text.data()) {
+                _text.assign(json.data(), json.size());
+            }
+            if (!_simd_parser) {
+                _simd_parser.reset(new JsonSimdParser());
+            }
+            _parse_lazy(&_root, 0, _text.size());
+        } else if (_backend == Backend::simd
+                && JsonStructuralIndex::best_level() != JsonStructuralIndex::Level::scalar
+                && json.size() <= JsonStructuralIndex::max_size) {
+            _parse_simd(json);
+        } else if (_backend == Backend::parallel) {
+            _parse_parallel(json);
+        } else {
+            _root.Parse(json.data(), json.size());
+            _check_parse();
+        }
+        if (_index_eagerly) {
+            _index_members(&_root);
+        }
+    }
+
+    // Choose the parser for subsequent `reset`s.
+    void set_backend(Backend backend)
+    {
+        _backend = backend;
+    }
+
+    Backend backend() const
+    {
+        return _backend;
+    }
+
+    // Number of threads of the `parallel` backend. 0, the default, means
+    // as many as the hardware runs concurrently.
+    void set_threads(size_t n_threads)
+    {
+        _n_threads = n_threads;
+    }
+
+    // Look up members of objects that have at least `threshold` members through
+    // a hash table (see `JsonMemberIndex`) rather than rapidjson's linear scan.
+    // The table of an object is built on the first lookup in it, or, if `eager` is `true`,
+    // right away (and after each `reset`) for all such objects in the document.
+    // A `threshold` of 0 turns the index off.
+    //
+    // Either way, `const` methods may be called on multiple threads at once, as without
+    // the index: tables built on first lookup are added under a lock. The lock is taken
+    // on every lookup in an indexed object, though, so a reader that is shared by threads
+    // is better indexed eagerly. (Except with the `lazy` backend; see `Backend`.)
+    void index_members(size_t threshold, bool eager = false)
+    {
+        _index_threshold = threshold;
+        _index_eagerly = eager && threshold > 0;
+        _member_indices.clear();
+        if (_index_eagerly) {
+            _index_members(&_root);
+        }
+    }
+
     template <typename... Names>
     void seek(Names&&... names)
     {
@@ -60,7 +623,7 @@ class JsonReader
     template <typename... Names>
     bool is_string(Names&&... names) const
     {
-        return _type_name(_cseek(_cursor, std::forward<Names>(names)...))->IsString();
+        return _cseek(_cursor, std::forward<Names>(names)...)->IsString();
     }
 
     template <typename... Names>
@@ -126,43 +689,43 @@ class JsonReader
     template <typename... Names>
     bool is_string_array(Names&&... names) const
     {
-        return _is_typed_array(_cseek(_cursor, std::forward<Names>(names)...), "string");
+        return _is_typed_array<string>(_cseek(_cursor, std::forward<Names>(names)...));
     }
 
     template <typename... Names>
     bool is_int_array(Names&&... names) const
     {
-        return _is_typed_array(_cseek(_cursor, std::forward<Names>(names)...), "int");
+        return _is_typed_array<int>(_cseek(_cursor, std::forward<Names>(names)...));
     }
 
     template <typename... Names>
     bool is_uint_array(Names&&... names) const
     {
-        return _is_typed_array(_cseek(_cursor, std::forward<Names>(names)...), "uint");
+        return _is_typed_array<unsigned>(_cseek(_cursor, std::forward<Names>(names)...));
     }
 
     template <typename... Names>
     bool is_long_array(Names&&... names) const
     {
-        return _is_typed_array(_cseek(_cursor, std::forward<Names>(names)...), "long");
+        return _is_typed_array<long>(_cseek(_cursor, std::forward<Names>(names)...));
     }
 
     template <typename... Names>
     bool is_double_array(Names&&... names) const
     {
-        return _is_typed_array(_cseek(_cursor, std::forward<Names>(names)...), "double");
+        return _is_typed_array<double>(_cseek(_cursor, std::forward<Names>(names)...));
     }
 
     template <typename... Names>
     bool is_float_array(Names&&... names) const
     {
-        return _is_typed_array(_cseek(_cursor, std::forward<Names>(names)...), "float");
+        return _is_typed_array<float>(_cseek(_cursor, std::forward<Names>(names)...));
     }
 
     template <typename... Names>
     bool is_bool_array(Names&&... names) const
     {
-        return _is_typed_array(_cseek(_cursor, std::forward<Names>(names)...), "bool");
+        return _is_typed_array<bool>(_cseek(_cursor, std::forward<Names>(names)...));
     }
 
     template <typename... Names>
@@ -175,7 +738,7 @@ class JsonReader
     size_t get_array_size(Names&&... names) const
     {
         auto cursor = _cseek(_cursor, std::forward<Names>(names)...);
-        _assert_type(cursor, "array");
+        _assert_type(cursor, cursor->IsArray(), "array");
         return cursor->Size();
     }
 
@@ -192,16 +755,424 @@ class JsonReader
         return _get_vector<T>(cursor);
     }
 
+    // Copy the elements of the specified array into the caller's buffer `out`,
+    // which has room for `capacity` elements. Returns the number of elements copied.
+    // Throws if the buffer is too small or an element is not of type `T`; in the latter case
+    // the buffer is partially overwritten.
+    //
+    // The types are checked in the same pass that copies, without bounds checks per element.
+    // The caller controls the buffer, hence its alignment and reuse across calls.
+    template <typename T, typename... Names>
+    size_t copy_vector(T* out, size_t capacity, Names&&... names) const
+    {
+        auto cursor = _cseek(_cursor, std::forward<Names>(names)...);
+        return _copy_array(cursor, out, capacity);
+    }
+
+    // Copy the specified array of arrays, e.g. an embedding matrix, into the caller's buffer
+    // `out` in row-major order. Returns the numbers of rows and columns.
+    // All rows must have the same size. Otherwise like `copy_vector`.
+    template <typename T, typename... Names>
+    std::pair<size_t, size_t> copy_matrix(T* out, size_t capacity, Names&&... names) const
+    {
+        auto cursor = _cseek(_cursor, std::forward<Names>(names)...);
+        _assert_type(cursor, cursor->IsArray(), "array");
+        size_t nrows = cursor->Size();
+        if (nrows == 0) {
+            return {0, 0};
+        }
+        auto rows = cursor->Begin();
+        _materialize(rows);
+        _assert_type(rows, rows->IsArray(), "array");
+        size_t ncols = rows->Size();
+        if (nrows * ncols > capacity) {
+            throw Error(make_string(
+                            "buffer of capacity ",
+                            capacity,
+                            " is too small for matrix of shape ",
+                            nrows, " x ", ncols));
+        }
+        for (size_t i = 0; i < nrows; i++) {
+            auto row = _materialize(rows + i);
+            _assert_type(row, row->IsArray(), "array");
+            if (row->Size() != ncols) {
+                throw Error(make_string(
+                                "row ", i, " has ", row->Size(),
+                                " elements while row 0 has ", ncols));
+            }
+            _copy_array(row, out + i * ncols, ncols);
+        }
+        return {nrows, ncols};
+    }
+
+    // Read all the values of a `JsonQuery` at once.
+    template <typename... Ts>
+    std::tuple<Ts...> query(JsonQuery<Ts...> const& q) const
+    {
+        vector<Cursor> found(sizeof...(Ts));
+        _resolve(_cursor, q.trie().root(), found);
+        _resolve(&_root, q.trie().document_root(), found);
+        return _query_values<Ts...>(found, std::index_sequence_for<Ts...>());
+    }
+
   private:
+    // A pool allocator keeps its bookkeeping at the start of the buffer it is given.
+    static constexpr size_t _pool_overhead = 256;
+    // The parser allocates a stack of this many bytes, for the string being parsed,
+    // from the same allocator as the document's stack; both are freed after each parse.
+    static constexpr size_t _reader_stack_size = 256;
+
+    size_t _arena_size;
+    size_t _stack_size;
+    size_t _stack_arena_size;
+    size_t _chunk_size;
+    std::unique_ptr<char[]> _arena;
+    std::unique_ptr<char[]> _stack_arena;
+    // Mutable because lazy parsing happens in `const` methods.
+    mutable Allocator _allocator;
+    Allocator _stack_allocator;
+    MappedFile _buffer;
     JsonDoc _root;
     JsonValue const* _cursor;
     vector<JsonValue const*> _cursor_stack;
+    Backend _backend = Backend::rapidjson;
+    std::unique_ptr<JsonSimdParser> _simd_parser;
+    size_t _n_threads = 0;
+    // Arenas of the elements of the root array, in parallel mode.
+    vector<std::unique_ptr<Allocator>> _run_allocators;
+    // Text of the document and spans of the values not parsed yet, in lazy mode.
+    string _text;
+    mutable std::unordered_map<Cursor, std::pair<size_t, size_t>> _placeholders;
+    size_t _index_threshold = 0;
+    bool _index_eagerly = false;
+    mutable std::unordered_map<Cursor, JsonMemberIndex> _member_indices;
+    mutable std::mutex _index_mutex;
 
-    Cursor _cseek(Cursor cursor) const
+    void _index_members(Cursor cursor)
     {
+        if (cursor->IsObject()) {
+            if (cursor->MemberCount() >= _index_threshold) {
+                _member_indices.emplace(cursor, JsonMemberIndex(*cursor));
+            }
+            for (auto it = cursor->MemberBegin(); it != cursor->MemberEnd(); ++it) {
+                _index_members(&it->value);
+            }
+        } else if (cursor->IsArray()) {
+            for (auto it = cursor->Begin(); it != cursor->End(); ++it) {
+                _index_members(it);
+            }
+        }
+    }
+
+    // The index of the object `cursor`, which is built if it does not exist yet.
+    // Indices are built under a lock, because `const` methods may be called on multiple
+    // threads. Once built, an index is not modified, and elements of the map do not move.
+    // An eager reader has built all indices in `reset`, hence it does not lock.
+    JsonMemberIndex const& _member_index(Cursor cursor) const
+    {
+        std::unique_lock<std::mutex> lock(_index_mutex, std::defer_lock);
+        if (!_index_eagerly) {
+            lock.lock();
+        }
+        auto it = _member_indices.find(cursor);
+        if (it == _member_indices.end()) {
+            it = _member_indices.emplace(cursor, JsonMemberIndex(*cursor)).first;
+        }
+        return it->second;
+    }
+
+    // The value of the member `name` of the object `cursor`, or null if there is no such member.
+    Cursor _find_member(Cursor cursor, string const& name) const
+    {
+        if (_index_threshold > 0 && cursor->MemberCount() >= _index_threshold) {
+            return _member_index(cursor).find(name.data(), name.size());
+        }
+        auto key = JsonValue(name.data(), static_cast<rapidjson::SizeType>(name.size()));
+        auto it = cursor->FindMember(key);
+        if (it == cursor->MemberEnd()) {
+            return nullptr;
+        }
+        return &it->value;
+    }
+
+    void _parse_simd(string_view json)
+    {
+        if (!_simd_parser) {
+            _simd_parser.reset(new JsonSimdParser());
+        }
+        auto generator = [&](JsonDoc& handler) {
+            _simd_parser->parse(json.data(), json.size(), handler);
+            return true;
+        };
+        _root.Populate(generator);
+    }
+
+    void _parse_parallel(string_view json)
+    {
+        size_t n_threads = _n_threads;
+        if (n_threads == 0) {
+            n_threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+        }
+        vector<size_t> bounds;
+        if (n_threads > 1 && json.size() >= (1 << 20)) {
+            bounds = JsonStructuralIndex().split_array(json.data(), json.size(), n_threads);
+        }
+        if (bounds.size() < 3) {
+            // Not an array, or too short to split.
+            _root.Parse(json.data(), json.size());
+            _check_parse();
+            return;
+        }
+
+        size_t n_runs = bounds.size() - 1;
+        vector<std::unique_ptr<JsonDoc>> docs(n_runs);
+        vector<string> errors(n_runs);
+        for (size_t i = 0; i < n_runs; i++) {
+            _run_allocators.emplace_back(new Allocator(_chunk_size));
+        }
+        auto parse_run = [&](size_t i) {
+            try {
+                // The elements of the run, between a bracket or comma and the next,
+                // are parsed one by one where they are in `json`.
+                auto& allocator = *_run_allocators[i];
+                docs[i].reset(new JsonDoc(&allocator));
+                docs[i]->SetArray();
+                // A pool does not free, hence the parse stacks of an element would stay
+                // in the pool to the end of the run. Their own arena is cleared after
+                // each element instead; the stacks are released by then.
+                std::unique_ptr<char[]> stack_arena(new char[_stack_arena_size]);
+                Allocator stack_allocator(stack_arena.get(), _stack_arena_size, _chunk_size);
+                JsonDoc elem(&allocator, _stack_size, &stack_allocator);
+                size_t pos = bounds[i] + 1;
+                size_t end = bounds[i + 1];
+                while (true) {
+                    rapidjson::MemoryStream in(json.data() + pos, end - pos);
+                    elem.ParseStream<rapidjson::kParseStopWhenDoneFlag>(in);
+                    if (elem.HasParseError()) {
+                        // Where an element is missing, the stream is empty up to the comma.
+                        auto code = elem.GetParseError();
+                        if (code == rapidjson::kParseErrorDocumentEmpty) {
+                            code = rapidjson::kParseErrorValueInvalid;
+                        }
+                        errors[i] = make_string(
+                                        "failed to parse JSON at offset ",
+                                        pos + elem.GetErrorOffset(),
+                                        ": ",
+                                        rapidjson::GetParseError_En(code));
+                        return;
+                    }
+                    docs[i]->PushBack(elem, allocator);
+                    stack_allocator.Clear();
+                    pos += in.Tell();
+                    while (pos < end && (json[pos] == ' ' || json[pos] == '\t' || json[pos] == '\n' || json[pos] == '\r')) {
+                        pos++;
+                    }
+                    if (pos == end) {
+                        break;
+                    }
+                    if (json[pos] != ',') {
+                        errors[i] = make_string(
+                                        "failed to parse JSON at offset ",
+                                        pos,
+                                        ": ",
+                                        rapidjson::GetParseError_En(
+                                            rapidjson::kParseErrorArrayMissCommaOrSquareBracket));
+                        return;
+                    }
+                    pos++;
+                }
+            } catch (std::exception const& e) {
+                errors[i] = e.what();
+            }
+        };
+        vector<std::thread> threads;
+        for (size_t i = 1; i < n_runs; i++) {
+            threads.emplace_back(parse_run, i);
+        }
+        parse_run(0);
+        for (auto& t : threads) {
+            t.join();
+        }
+        for (auto const& e : errors) {
+            if (!e.empty()) {
+                throw Error(e);
+            }
+        }
+
+        // Only the values are moved; what they point to stays in the arenas of the runs.
+        size_t size = 0;
+        for (auto const& doc : docs) {
+            size += doc->Size();
+        }
+        _root.SetArray();
+        _root.Reserve(static_cast<rapidjson::SizeType>(size), _allocator);
+        for (auto& doc : docs) {
+            for (auto& v : doc->GetArray()) {
+                _root.PushBack(v, _allocator);
+            }
+        }
+    }
+
+    // Builds one level of a document in lazy mode from the events of
+    // `JsonSimdParser::parse_shallow`.
+    struct _LazyBuilder {
+        Allocator& allocator;
+        JsonValue value;
+        JsonValue key;
+        bool in_container = false;
+        // Position of each skipped child in `value`, and its span in the text.
+        vector<std::tuple<size_t, size_t, size_t>> skipped;
+
+        explicit _LazyBuilder(Allocator& allocator)
+            : allocator(allocator)
+        {
+        }
+
+        bool add(JsonValue& v)
+        {
+            if (!in_container) {
+                value = v;
+            } else if (value.IsObject()) {
+                value.AddMember(key, v, allocator);
+            } else {
+                value.PushBack(v, allocator);
+            }
+            return true;
+        }
+
+        bool Null()
+        {
+            JsonValue v;
+            return add(v);
+        }
+
+        template <typename T>
+        bool add_scalar(T x)
+        {
+            JsonValue v(x);
+            return add(v);
+        }
+
+        bool Bool(bool x)
+        {
+            return add_scalar(x);
+        }
+
+        bool Int(int x)
+        {
+            return add_scalar(x);
+        }
+
+        bool Uint(unsigned x)
+        {
+            return add_scalar(x);
+        }
+
+        bool Int64(int64_t x)
+        {
+            return add_scalar(x);
+        }
+
+        bool Uint64(uint64_t x)
+        {
+            return add_scalar(x);
+        }
+
+        bool Double(double x)
+        {
+            return add_scalar(x);
+        }
+
+        bool String(char const* str, rapidjson::SizeType len, bool)
+        {
+            JsonValue v(str, len, allocator);
+            return add(v);
+        }
+
+        bool Key(char const* str, rapidjson::SizeType len, bool)
+        {
+            key.SetString(str, len, allocator);
+            return true;
+        }
+
+        bool StartObject()
+        {
+            value.SetObject();
+            in_container = true;
+            return true;
+        }
+
+        bool StartArray()
+        {
+            value.SetArray();
+            in_container = true;
+            return true;
+        }
+
+        bool EndObject(rapidjson::SizeType)
+        {
+            return true;
+        }
+
+        bool EndArray(rapidjson::SizeType)
+        {
+            return true;
+        }
+
+        bool Skipped(size_t begin, size_t end)
+        {
+            skipped.emplace_back(value.IsObject() ? value.MemberCount() : value.Size(), begin, end);
+            return Null();
+        }
+    };
+
+    // Parse the value in `_text[begin, end)` one level deep into `target`.
+    void _parse_lazy(JsonValue* target, size_t begin, size_t end) const
+    {
+        _LazyBuilder builder(_allocator);
+        _simd_parser->parse_shallow(_text.data(), end, begin, builder);
+        *target = builder.value;
+        for (auto const& [pos, b, e] : builder.skipped) {
+            Cursor child = target->IsObject()
+                           ? &(target->MemberBegin() + pos)->value
+                           : &(*target)[static_cast<rapidjson::SizeType>(pos)];
+            _placeholders.emplace(child, std::make_pair(b, e));
+        }
+    }
+
+    // In lazy mode, parse the array or object that `cursor` is a placeholder of, if any.
+    // The placeholder is replaced in place, hence `cursor` stays valid.
+    Cursor _materialize(Cursor cursor) const
+    {
+        if (_placeholders.empty()) {
+            return cursor;
+        }
+        auto it = _placeholders.find(cursor);
+        if (it == _placeholders.end()) {
+            return cursor;
+        }
+        auto span = it->second;
+        _placeholders.erase(it);
+        _parse_lazy(const_cast<JsonValue*>(cursor), span.first, span.second);
         return cursor;
     }
 
+    void _check_parse() const
+    {
+        if (_root.HasParseError()) {
+            throw Error(make_string(
+                            "failed to parse JSON at offset ",
+                            _root.GetErrorOffset(),
+                            ": ",
+                            rapidjson::GetParseError_En(_root.GetParseError())));
+        }
+    }
+
+    Cursor _cseek(Cursor cursor) const
+    {
+        return _materialize(cursor);
+    }
+
     template <typename... Names>
     Cursor _cseek(Cursor cursor, string const& name, Names&&... names) const
     {
@@ -210,10 +1181,10 @@ class JsonReader
         } else if (name == "") {
             throw Error("can not seek an element with empty name");
         } else {
-            _assert_type(cursor, "object");
-            if (cursor->HasMember(name.c_str())) {
-                cursor = &(*cursor)[name.c_str()];
-            } else {
+            cursor = _materialize(cursor);
+            _assert_type(cursor, cursor->IsObject(), "object");
+            cursor = _find_member(cursor, name);
+            if (!cursor) {
                 throw Error(make_string("can not find member named '", name, "'"));
             }
         }
@@ -223,7 +1194,8 @@ class JsonReader
     template <typename... Names>
     Cursor _cseek(Cursor cursor, size_t pos, Names&&... names) const
     {
-        _assert_type(cursor, "array");
+        cursor = _materialize(cursor);
+        _assert_type(cursor, cursor->IsArray(), "array");
         auto n = cursor->Size();
         if (pos >= n) {
             throw Error(make_string(
@@ -238,6 +1210,7 @@ class JsonReader
 
     string _type_name(Cursor cursor) const
     {
+        cursor = _materialize(cursor);
         // auto const type = cursor->GetType();
         // if (type == rapidjson::kNullType) return "null";
         // if (type == rapidjson::kFalseType) return "false";
@@ -272,9 +1245,11 @@ class JsonReader
         return "unknown";
     }
 
-    void _assert_type(Cursor cursor, string_view type) const
+    // The type name is only needed in the error message, hence is not computed
+    // unless `matches` is `false`.
+    void _assert_type(Cursor cursor, bool matches, char const* type) const
     {
-        if (_type_name(cursor) != type) {
+        if (!matches) {
             throw Error(make_string(
                             "encountered element of type '",
                             _type_name(cursor),
@@ -284,7 +1259,14 @@ class JsonReader
         }
     }
 
-    bool _is_typed_array(Cursor cursor, string_view type) const
+    template <typename T>
+    void _assert_type(Cursor cursor) const
+    {
+        _assert_type(cursor, json_type_of<T>::check(*cursor), json_type_of<T>::name);
+    }
+
+    template <typename T>
+    bool _is_typed_array(Cursor cursor) const
     {
         if (!cursor->IsArray()) {
             return false;
@@ -292,24 +1274,14 @@ class JsonReader
         if (cursor->Size() < 1) {
             throw Error("can not determine element type of an empty array");
         }
-        return (_type_name(_cseek(cursor, 0)) == type);
-    }
-
-    void _assert_array_elem_type(Cursor cursor, string_view type) const
-    {
-        if (!_is_typed_array(cursor, type)) {
-            throw Error(make_string(
-                            "encountered array with elements of type '",
-                            _type_name(_cseek(cursor, 0)),
-                            "' while type '", type, "' is expected"));
-        }
+        return json_type_of<T>::check(*cursor->Begin());
     }
 
     template <typename... Names>
     bool _has_member(Cursor cursor, Names&&... names) const
     {
         try {
-            auto cursor = _cseek(cursor, std::forward<Names>(names)...);
+            _cseek(cursor, std::forward<Names>(names)...);
             return true;
         } catch (std::exception& e) {
             return false;
@@ -317,20 +1289,108 @@ class JsonReader
     }
 
     template <typename T>
-    T _get_scalar(Cursor cursor) const;
-    // To be specialized outside of the class.
+    T _get_scalar(Cursor cursor) const
+    {
+        _assert_type<T>(cursor);
+        return json_type_of<T>::get(*cursor);
+    }
 
     template <typename T>
     vector<T> _get_vector(Cursor cursor) const
     {
-        _assert_type(cursor, "array");
-        _assert_array_elem_type(cursor, zpz::type_name<T>());
+        _assert_type(cursor, cursor->IsArray(), "array");
         auto n = cursor->Size();
-        auto values = vector<T>(n);
+        vector<T> values;
+        if constexpr (std::is_same<T, bool>::value) {
+            // `vector<bool>` has no buffer to copy into.
+            values.reserve(n);
+            for (auto elem = cursor->Begin(); elem != cursor->End(); elem++) {
+                _assert_type<bool>(elem);
+                values.push_back(elem->GetBool());
+            }
+        } else {
+            values.resize(n);
+            _copy_array(cursor, values.data(), n);
+        }
+        return values;
+    }
+
+    void _resolve(Cursor cursor, JsonPathTrie::Node const& node, vector<Cursor>& found) const
+    {
+        cursor = _materialize(cursor);
+        for (auto slot : node.slots) {
+            found[slot] = cursor;
+        }
+        if (!node.members.empty()) {
+            _assert_type(cursor, cursor->IsObject(), "object");
+            for (auto const& [name, child] : node.members) {
+                auto member = _find_member(cursor, name);
+                if (!member) {
+                    throw Error(make_string("can not find member named '", name, "'"));
+                }
+                _resolve(member, *child, found);
+            }
+        }
+        if (!node.items.empty()) {
+            _assert_type(cursor, cursor->IsArray(), "array");
+            size_t n = cursor->Size();
+            for (auto const& [pos, child] : node.items) {
+                if (pos >= n) {
+                    throw Error(make_string(
+                                    "can not seek item <", pos, "> in array because array size is ", n));
+                }
+                _resolve(cursor->Begin() + pos, *child, found);
+            }
+        }
+    }
+
+    template <typename T>
+    struct _is_vector : std::false_type {
+    };
+
+    template <typename T>
+    struct _is_vector<vector<T>> : std::true_type {
+    };
+
+    template <typename T>
+    T _query_value(Cursor cursor) const
+    {
+        if constexpr (_is_vector<T>::value) {
+            return _get_vector<typename T::value_type>(cursor);
+        } else {
+            return _get_scalar<T>(cursor);
+        }
+    }
+
+    template <typename... Ts, size_t... I>
+    std::tuple<Ts...> _query_values(vector<Cursor> const& found, std::index_sequence<I...>) const
+    {
+        return std::tuple<Ts...>(_query_value<Ts>(found[I])...);
+    }
+
+    template <typename T>
+    size_t _copy_array(Cursor cursor, T* out, size_t capacity) const
+    {
+        _assert_type(cursor, cursor->IsArray(), "array");
+        size_t n = cursor->Size();
+        if (n > capacity) {
+            throw Error(make_string(
+                            "buffer of capacity ",
+                            capacity,
+                            " is too small for array of size ",
+                            n));
+        }
+        auto elems = cursor->Begin();
         for (size_t i = 0; i < n; i++) {
-            values[i] = _get_scalar<T>(_cseek(cursor, i));
+            if (!json_type_of<T>::check(elems[i])) {
+                throw Error(make_string(
+                                "encountered array element ", i, " of type '",
+                                _type_name(elems + i),
+                                "' while type '", json_type_of<T>::name, "' is expected"));
+            }
+            out[i] = json_type_of<T>::get(elems[i]);
         }
-        return std::move(values);
+        return n;
     }
 
     void _check_cursor() const
@@ -341,50 +1401,134 @@ class JsonReader
     }
 };
 
-// Explicit full specialization can not happen within a class;
-// has to be place directly in the namespace scope.
 
-template <>
-string JsonReader::_get_scalar<string>(Cursor cursor) const
+class JsonLinesReader
 {
-    _assert_type(cursor, "string");
-    return cursor->GetString();
-}
+    // Reads a file of newline-delimited JSON documents ("JSON Lines") on multiple threads.
+    //
+    // The calling thread reads the file in chunks of about `chunk_size` bytes, cut at
+    // line ends, and hands them to `n_threads` worker threads (default is the number
+    // of cores). Each worker keeps a `JsonReader`, which it `reset`s to one line after
+    // another, and passes it to the callback:
+    //
+    //    JsonLinesReader reader("events.json", 8);
+    //    reader.for_each([&](JsonReader& record) {
+    //        auto id = record.get_scalar<long>("id");
+    //    });
+    //
+    // The callback is called concurrently from the worker threads, in no particular order,
+    // and must be thread-safe. Blank lines are skipped. The number of chunks in flight
+    // is bounded, so memory use does not grow with the size of the file.
 
-template <>
-int JsonReader::_get_scalar<int>(Cursor cursor) const
-{
-    _assert_type(cursor, "int");
-    return cursor->GetInt();
-}
+  public:
+    JsonLinesReader(char const* filename, size_t n_threads = 0, size_t chunk_size = 16 * 1024 * 1024)
+        : _filename(filename)
+        , _n_threads(n_threads > 0 ? n_threads : std::max(1u, std::thread::hardware_concurrency()))
+        , _chunk_size(std::max<size_t>(chunk_size, 4096))
+    {
+        check_file_exists(filename);
+    }
 
-template <>
-double JsonReader::_get_scalar<double>(Cursor cursor) const
-{
-    _assert_type(cursor, "double");
-    return cursor->GetDouble();
-}
+    // Call `f(JsonReader&)` on every line of the file.
+    template <typename F>
+    void for_each(F f)
+    {
+        BlockingQueue<string> queue(_n_threads * 2);
+        std::mutex mutex;
+        std::exception_ptr error;
 
-template <>
-float JsonReader::_get_scalar<float>(Cursor cursor) const
-{
-    _assert_type(cursor, "float");
-    return cursor->GetFloat();
-}
+        auto fail = [&](std::exception_ptr e) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error) {
+                    error = e;
+                }
+            }
+            queue.close();
+        };
 
-template <>
-long JsonReader::_get_scalar<long>(Cursor cursor) const
-{
-    _assert_type(cursor, "long");
-    return cursor->GetInt64();
-}
+        auto work = [&]() {
+            try {
+                JsonReader reader(JsonReader::ArenaOptions{});
+                string chunk;
+                while (queue.pop(chunk)) {
+                    char const* p = chunk.data();
+                    char const* end = p + chunk.size();
+                    while (p < end) {
+                        auto q = static_cast<char const*>(std::memchr(p, '\n', end - p));
+                        if (!q) {
+                            q = end;
+                        }
+                        auto line = string_view(p, q - p);
+                        p = q + 1;
+                        if (line.find_first_not_of(" \t\r") == string_view::npos) {
+                            continue;
+                        }
+                        reader.reset(line);
+                        f(reader);
+                    }
+                }
+            } catch (...) {
+                fail(std::current_exception());
+            }
+        };
 
-template <>
-bool JsonReader::_get_scalar<bool>(Cursor cursor) const
-{
-    _assert_type(cursor, "bool");
-    return cursor->GetBool();
-}
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < _n_threads; i++) {
+            workers.emplace_back(work);
+        }
+
+        try {
+            std::ifstream in(_filename, std::ios::binary);
+            if (!in) {
+                throw Error(make_string("could not open file '", _filename, "': ", std::strerror(errno)));
+            }
+            string carry;
+            while (true) {
+                string chunk = std::move(carry);
+                carry = string();
+                auto n = chunk.size();
+                chunk.resize(n + _chunk_size);
+                in.read(&chunk[n], _chunk_size);
+                chunk.resize(n + in.gcount());
+                if (chunk.empty()) {
+                    break;
+                }
+                if (in) {
+                    // Leave the incomplete last line for the next chunk.
+                    auto pos = chunk.rfind('\n');
+                    if (pos == string::npos) {
+                        carry = std::move(chunk);
+                        continue;
+                    }
+                    carry.assign(chunk, pos + 1, string::npos);
+                    chunk.resize(pos + 1);
+                }
+                if (!queue.push(std::move(chunk))) {
+                    break;
+                }
+                if (!in) {
+                    break;
+                }
+            }
+        } catch (...) {
+            fail(std::current_exception());
+        }
+        queue.close();
+
+        for (auto& t : workers) {
+            t.join();
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+  private:
+    string _filename;
+    size_t _n_threads;
+    size_t _chunk_size;
+};
 
 } // namespace zpz
 #endif // _zpz_utilities_json_h_
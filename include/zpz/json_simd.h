@@ -0,0 +1,1012 @@
+#ifndef _zpz_utilities_json_simd_h_
+#define _zpz_utilities_json_simd_h_
+
+#include "exception.h"
+#include "string.h"
+
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ZPZ_JSON_SIMD_X86 1
+#endif
+
+namespace zpz
+{
+
+class JsonStructuralIndex
+{
+    // Stage 1 of a two-stage JSON parser: finds the positions of all structural
+    // characters (`{}[]:,`) and the first characters of all strings, numbers and
+    // literals, 64 bytes at a time.
+    //
+    // For each block of 64 bytes, SIMD comparisons produce bitmasks of quotes,
+    // backslashes, operators and whitespace. Escaped quotes are removed by bit arithmetic
+    // on runs of backslashes, and the mask of string contents is the prefix XOR of
+    // the remaining quotes. Everything in the block is then branch-free bit manipulation,
+    // carrying three bits of state into the next block.
+    //
+    // The instruction set is chosen at runtime: AVX2 if the CPU has it, SSE2 otherwise
+    // (always present on x86-64). Elsewhere a scalar loop fills the same masks.
+    //
+    // Positions are 32-bit, hence the input must be shorter than 4 GiB.
+
+  public:
+    enum class Level {
+        scalar,
+        sse2,
+        avx2
+    };
+
+    // The fastest level supported by the CPU.
+    static Level best_level()
+    {
+#ifdef ZPZ_JSON_SIMD_X86
+        static Level const level = __builtin_cpu_supports("avx2")
+                                   ? Level::avx2
+                                   : (__builtin_cpu_supports("sse2") ? Level::sse2 : Level::scalar);
+        return level;
+#else
+        return Level::scalar;
+#endif
+    }
+
+    static constexpr size_t max_size = std::numeric_limits<uint32_t>::max();
+
+    explicit JsonStructuralIndex(Level level = best_level())
+        : _level(level)
+    {
+#ifndef ZPZ_JSON_SIMD_X86
+        _level = Level::scalar;
+#endif
+    }
+
+    Level level() const
+    {
+        return _level;
+    }
+
+    // Index `data`, replacing the previous index.
+    // Throws if a string is not closed at the end of the input.
+    void build(char const* data, size_t size)
+    {
+        if (size > max_size) {
+            throw Error(make_string(
+                            "JSON input of ", size, " bytes is too large for the structural index"));
+        }
+        // The positions are written through a pointer into `_positions`, which is kept
+        // at least 64 entries longer than the count, and trimmed at the end.
+        size_t count = 0;
+        _positions.resize(size / 4 + 64);
+        _scan(data, size, [this, &count](size_t offset, uint64_t structural) {
+            if (_positions.size() - count < 64) {
+                _positions.resize(_positions.size() * 2);
+            }
+            uint32_t* out = _positions.data() + count;
+            count += __builtin_popcountll(structural);
+            while (structural) {
+                *out++ = static_cast<uint32_t>(offset + __builtin_ctzll(structural));
+                structural &= structural - 1;
+            }
+        });
+        _positions.resize(count);
+    }
+
+    // Split a top-level array into about `n_parts` runs of whole elements, of similar
+    // lengths, without building the index. Returns the positions of the opening bracket,
+    // the commas between runs, and the closing bracket; the runs are between consecutive
+    // positions. Returns an empty vector if `data` is not an array.
+    //
+    // Only the nesting is checked, not the values or the kind of brackets, which are left
+    // to whoever parses the runs. Throws if the brackets are unbalanced or the array is
+    // followed by anything but whitespace.
+    //
+    // Unlike `build`, this has no limit on `size`.
+    std::vector<size_t> split_array(char const* data, size_t size, size_t n_parts) const
+    {
+        std::vector<size_t> bounds;
+        size_t first = 0;
+        while (first < size && _is_space(data[first])) {
+            first++;
+        }
+        if (first == size || data[first] != '[') {
+            return bounds;
+        }
+        if (n_parts == 0) {
+            n_parts = 1;
+        }
+        size_t step = (size - first) / n_parts + 1;
+        size_t target = first + step;
+        size_t depth = 0;
+        bool closed = false;
+        _scan(data, size, [&](size_t offset, uint64_t structural) {
+            while (structural) {
+                size_t pos = offset + __builtin_ctzll(structural);
+                structural &= structural - 1;
+                if (closed) {
+                    throw Error(make_string(
+                                    "failed to parse JSON at offset ", pos,
+                                    ": the document root must not be followed by other values"));
+                }
+                switch (data[pos]) {
+                    case '[':
+                    case '{':
+                        if (depth++ == 0) {
+                            bounds.push_back(pos);
+                        }
+                        break;
+                    case ']':
+                    case '}':
+                        if (depth == 0) {
+                            throw Error(make_string(
+                                            "failed to parse JSON at offset ", pos, ": unexpected '",
+                                            data[pos], "'"));
+                        }
+                        if (--depth == 0) {
+                            bounds.push_back(pos);
+                            closed = true;
+                        }
+                        break;
+                    case ',':
+                        if (depth == 1 && pos >= target) {
+                            bounds.push_back(pos);
+                            target = pos + step;
+                        }
+                        break;
+                }
+            }
+        });
+        if (!closed) {
+            throw Error("failed to parse JSON: missing closing bracket of array");
+        }
+        return bounds;
+    }
+
+    std::vector<uint32_t> const& positions() const
+    {
+        return _positions;
+    }
+
+    size_t size() const
+    {
+        return _positions.size();
+    }
+
+    uint32_t operator[](size_t i) const
+    {
+        return _positions[i];
+    }
+
+  private:
+    struct _Masks {
+        uint64_t quote;
+        uint64_t backslash;
+        uint64_t op;
+        uint64_t space;
+    };
+
+    Level _level;
+    std::vector<uint32_t> _positions;
+
+    // Call `sink(offset, structural)` with the bitmask of structural characters
+    // of each block of 64 bytes, starting at `offset`.
+    template <typename Sink>
+    void _scan(char const* data, size_t size, Sink&& sink) const
+    {
+        switch (_level) {
+#ifdef ZPZ_JSON_SIMD_X86
+            case Level::avx2:
+                _scan<_masks_avx2>(data, size, sink);
+                break;
+            case Level::sse2:
+                _scan<_masks_sse2>(data, size, sink);
+                break;
+#endif
+            default:
+                _scan<_masks_scalar>(data, size, sink);
+        }
+    }
+
+    template <void (*masks)(char const*, _Masks&), typename Sink>
+    static void _scan(char const* data, size_t size, Sink& sink)
+    {
+        uint64_t prev_escaped = 0;
+        uint64_t prev_in_string = 0;
+        uint64_t prev_scalar = 0;
+        char tail[64];
+        _Masks m;
+
+        for (size_t offset = 0; offset < size; offset += 64) {
+            char const* block = data + offset;
+            if (size - offset < 64) {
+                std::memset(tail, ' ', 64);
+                std::memcpy(tail, block, size - offset);
+                block = tail;
+            }
+            masks(block, m);
+
+            uint64_t escaped = _find_escaped(m.backslash, prev_escaped);
+            uint64_t quote = m.quote & ~escaped;
+            // From the opening quote of each string up to, not including, the closing quote.
+            uint64_t in_string = _prefix_xor(quote) ^ prev_in_string;
+            prev_in_string = static_cast<uint64_t>(static_cast<int64_t>(in_string) >> 63);
+            // String contents after the opening quote, including the closing quote.
+            uint64_t string_tail = in_string ^ quote;
+
+            uint64_t scalar = ~(m.op | m.space);
+            uint64_t nonquote_scalar = scalar & ~quote;
+            uint64_t follows_scalar = (nonquote_scalar << 1) | prev_scalar;
+            prev_scalar = nonquote_scalar >> 63;
+            uint64_t structural = (m.op | (scalar & ~follows_scalar)) & ~string_tail;
+
+            sink(offset, structural);
+        }
+
+        if (prev_in_string) {
+            throw Error("failed to parse JSON: missing closing quote of string");
+        }
+    }
+
+    // Characters that are escaped by an odd-length run of backslashes.
+    static uint64_t _find_escaped(uint64_t backslash, uint64_t& prev_escaped)
+    {
+        backslash &= ~prev_escaped;
+        uint64_t follows_escape = (backslash << 1) | prev_escaped;
+        uint64_t const even_bits = 0x5555555555555555ULL;
+        uint64_t odd_starts = backslash & ~even_bits & ~follows_escape;
+        unsigned long long even_starts;
+        prev_escaped = __builtin_uaddll_overflow(odd_starts, backslash, &even_starts);
+        uint64_t invert = static_cast<uint64_t>(even_starts) << 1;
+        return (even_bits ^ invert) & follows_escape;
+    }
+
+    static uint64_t _prefix_xor(uint64_t x)
+    {
+        x ^= x << 1;
+        x ^= x << 2;
+        x ^= x << 4;
+        x ^= x << 8;
+        x ^= x << 16;
+        x ^= x << 32;
+        return x;
+    }
+
+    static bool _is_space(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    static void _masks_scalar(char const* block, _Masks& m)
+    {
+        m = _Masks{0, 0, 0, 0};
+        for (int i = 0; i < 64; i++) {
+            uint64_t bit = uint64_t(1) << i;
+            switch (block[i]) {
+                case '"':
+                    m.quote |= bit;
+                    break;
+                case '\\':
+                    m.backslash |= bit;
+                    break;
+                case '{':
+                case '}':
+                case '[':
+                case ']':
+                case ':':
+                case ',':
+                    m.op |= bit;
+                    break;
+                case ' ':
+                case '\t':
+                case '\n':
+                case '\r':
+                    m.space |= bit;
+                    break;
+            }
+        }
+    }
+
+#ifdef ZPZ_JSON_SIMD_X86
+    // `[` and `]` differ from `{` and `}` only in bit 0x20, hence two comparisons
+    // after OR-ing that bit in cover all four brackets.
+
+    __attribute__((target("sse2")))
+    static void _masks_sse2(char const* block, _Masks& m)
+    {
+        m = _Masks{0, 0, 0, 0};
+        for (int k = 0; k < 4; k++) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(block + 16 * k));
+            __m128i b = _mm_or_si128(v, _mm_set1_epi8(0x20));
+            auto quote = _mm_cmpeq_epi8(v, _mm_set1_epi8('"'));
+            auto backslash = _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'));
+            auto op = _mm_or_si128(
+                          _mm_or_si128(_mm_cmpeq_epi8(b, _mm_set1_epi8('{')),
+                                       _mm_cmpeq_epi8(b, _mm_set1_epi8('}'))),
+                          _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(':')),
+                                       _mm_cmpeq_epi8(v, _mm_set1_epi8(','))));
+            auto space = _mm_or_si128(
+                             _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                                          _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+                             _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                                          _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+            int shift = 16 * k;
+            m.quote |= uint64_t(static_cast<uint16_t>(_mm_movemask_epi8(quote))) << shift;
+            m.backslash |= uint64_t(static_cast<uint16_t>(_mm_movemask_epi8(backslash))) << shift;
+            m.op |= uint64_t(static_cast<uint16_t>(_mm_movemask_epi8(op))) << shift;
+            m.space |= uint64_t(static_cast<uint16_t>(_mm_movemask_epi8(space))) << shift;
+        }
+    }
+
+    __attribute__((target("avx2")))
+    static void _masks_avx2(char const* block, _Masks& m)
+    {
+        m = _Masks{0, 0, 0, 0};
+        for (int k = 0; k < 2; k++) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(block + 32 * k));
+            __m256i b = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+            auto quote = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'));
+            auto backslash = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'));
+            auto op = _mm256_or_si256(
+                          _mm256_or_si256(_mm256_cmpeq_epi8(b, _mm256_set1_epi8('{')),
+                                          _mm256_cmpeq_epi8(b, _mm256_set1_epi8('}'))),
+                          _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')),
+                                          _mm256_cmpeq_epi8(v, _mm256_set1_epi8(','))));
+            auto space = _mm256_or_si256(
+                             _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                                             _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+                             _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+                                             _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))));
+            int shift = 32 * k;
+            m.quote |= uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(quote))) << shift;
+            m.backslash |= uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(backslash))) << shift;
+            m.op |= uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(op))) << shift;
+            m.space |= uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(space))) << shift;
+        }
+    }
+#endif
+};
+
+
+class JsonSimdParser
+{
+    // Two-stage JSON parser. Stage 1 is `JsonStructuralIndex`; stage 2 walks
+    // the structural positions with an explicit stack (no recursion) and reports
+    // the document as SAX events to a handler with the interface of rapidjson's
+    // handlers, e.g. `rapidjson::Document` or `rapidjson::Writer`:
+    //
+    //    bool Null();
+    //    bool Bool(bool);
+    //    bool Int(int);
+    //    bool Uint(unsigned);
+    //    bool Int64(int64_t);
+    //    bool Uint64(uint64_t);
+    //    bool Double(double);
+    //    bool String(char const* str, SizeType length, bool copy);
+    //    bool StartObject();
+    //    bool Key(char const* str, SizeType length, bool copy);
+    //    bool EndObject(SizeType member_count);
+    //    bool StartArray();
+    //    bool EndArray(SizeType element_count);
+    //
+    // Integers are reported through the narrowest of the integer events that fits,
+    // and through `Double` if they overflow 64 bits, as rapidjson does. Strings are
+    // unescaped into a scratch buffer, which is reused, hence `copy` is always `true`.
+    //
+    // Invalid JSON throws `Error` with the byte offset. So does a handler returning `false`.
+    // Like rapidjson's default, the parser does not validate UTF-8.
+    //
+    // To build a rapidjson document:
+    //
+    //    JsonSimdParser parser;
+    //    auto generator = [&](auto& handler) {
+    //        parser.parse(json, size, handler);
+    //        return true;
+    //    };
+    //    doc.Populate(generator);
+
+  public:
+    using Level = JsonStructuralIndex::Level;
+
+    explicit JsonSimdParser(Level level = JsonStructuralIndex::best_level())
+        : _index(level)
+    {
+    }
+
+    template <typename Handler>
+    void parse(char const* data, size_t size, Handler& handler)
+    {
+        _index.build(data, size);
+        _data = data;
+        _size = size;
+        _parse(handler);
+    }
+
+    // Report the value at `pos` to `handler` like `parse`, but if it is an array or object,
+    // do not parse the arrays and objects nested in it. Each of those is reported as
+    //
+    //    bool Skipped(size_t begin, size_t end);
+    //
+    // with its span in `data`, found by bracket matching, so that it can be parsed
+    // by another call when needed. Skipped values are not validated.
+    // Nothing but whitespace may follow the value up to `size`.
+    // This does not use the structural index.
+    template <typename Handler>
+    void parse_shallow(char const* data, size_t size, size_t pos, Handler& handler)
+    {
+        _data = data;
+        _size = size;
+        size_t p = _skip_space(pos);
+        if (p >= size) {
+            _fail(size, "the document is empty");
+        }
+        char c = data[p];
+        if (c == '{' || c == '[') {
+            p = _shallow_container(handler, p);
+        } else {
+            p = _scalar(handler, p);
+        }
+        p = _skip_space(p);
+        if (p < size) {
+            _fail(p, "the document root must not be followed by other values");
+        }
+    }
+
+    // The structural index of the last parsed document.
+    JsonStructuralIndex const& index() const
+    {
+        return _index;
+    }
+
+  private:
+    struct _Frame {
+        bool is_object;
+        unsigned count;
+    };
+
+    enum class _State {
+        value,
+        key,
+        after_value
+    };
+
+    JsonStructuralIndex _index;
+    char const* _data = nullptr;
+    size_t _size = 0;
+    std::vector<_Frame> _stack;
+    std::string _scratch;
+
+    template <typename Handler>
+    void _parse(Handler& handler)
+    {
+        auto const& pos = _index.positions();
+        size_t const n = pos.size();
+        if (n == 0) {
+            _fail(_size, "the document is empty");
+        }
+
+        _stack.clear();
+        size_t i = 0;
+        auto next = [&]() -> size_t {
+            if (i >= n) {
+                _fail(_size, "unexpected end of input");
+            }
+            return pos[i++];
+        };
+
+        auto state = _State::value;
+        while (true) {
+            switch (state) {
+                case _State::value: {
+                    size_t p = next();
+                    char c = _data[p];
+                    if (c == '{') {
+                        _check(handler.StartObject(), p);
+                        if (i < n && _data[pos[i]] == '}') {
+                            i++;
+                            _check(handler.EndObject(0), p);
+                            state = _State::after_value;
+                        } else {
+                            _stack.push_back(_Frame{true, 0});
+                            state = _State::key;
+                        }
+                    } else if (c == '[') {
+                        _check(handler.StartArray(), p);
+                        if (i < n && _data[pos[i]] == ']') {
+                            i++;
+                            _check(handler.EndArray(0), p);
+                            state = _State::after_value;
+                        } else {
+                            _stack.push_back(_Frame{false, 0});
+                            state = _State::value;
+                        }
+                    } else {
+                        _scalar(handler, p);
+                        state = _State::after_value;
+                    }
+                    break;
+                }
+                case _State::key: {
+                    size_t p = next();
+                    if (_data[p] != '"') {
+                        _fail(p, "expected the name of an object member");
+                    }
+                    size_t after;
+                    auto s = _string(p, after);
+                    _check(handler.Key(s.data(), static_cast<unsigned>(s.size()), true), p);
+                    p = next();
+                    if (_data[p] != ':') {
+                        _fail(p, "expected ':' after the name of an object member");
+                    }
+                    state = _State::value;
+                    break;
+                }
+                case _State::after_value: {
+                    if (_stack.empty()) {
+                        if (i < n) {
+                            _fail(pos[i], "the document root must not be followed by other values");
+                        }
+                        return;
+                    }
+                    auto& frame = _stack.back();
+                    frame.count++;
+                    size_t p = next();
+                    char c = _data[p];
+                    if (c == ',') {
+                        state = frame.is_object ? _State::key : _State::value;
+                    } else if (frame.is_object && c == '}') {
+                        _check(handler.EndObject(frame.count), p);
+                        _stack.pop_back();
+                    } else if (!frame.is_object && c == ']') {
+                        _check(handler.EndArray(frame.count), p);
+                        _stack.pop_back();
+                    } else {
+                        _fail(p, frame.is_object
+                              ? "expected ',' or '}' after an object member"
+                              : "expected ',' or ']' after an array element");
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+    // Returns the position after the container.
+    template <typename Handler>
+    size_t _shallow_container(Handler& handler, size_t p)
+    {
+        bool is_object = (_data[p] == '{');
+        char close = is_object ? '}' : ']';
+        _check(is_object ? handler.StartObject() : handler.StartArray(), p);
+        unsigned count = 0;
+        p = _skip_space(p + 1);
+        if (p < _size && _data[p] == close) {
+            p++;
+        } else {
+            while (true) {
+                if (is_object) {
+                    if (p >= _size || _data[p] != '"') {
+                        _fail(p, "expected the name of an object member");
+                    }
+                    size_t after;
+                    auto s = _string(p, after);
+                    _check(handler.Key(s.data(), static_cast<unsigned>(s.size()), true), p);
+                    p = _skip_space(after);
+                    if (p >= _size || _data[p] != ':') {
+                        _fail(p, "expected ':' after the name of an object member");
+                    }
+                    p = _skip_space(p + 1);
+                }
+                if (p >= _size) {
+                    _fail(p, "unexpected end of input");
+                }
+                if (_data[p] == '{' || _data[p] == '[') {
+                    size_t after = _skip_container(p);
+                    _check(handler.Skipped(p, after), p);
+                    p = after;
+                } else {
+                    p = _scalar(handler, p);
+                }
+                count++;
+                p = _skip_space(p);
+                if (p < _size && _data[p] == ',') {
+                    p = _skip_space(p + 1);
+                } else if (p < _size && _data[p] == close) {
+                    p++;
+                    break;
+                } else {
+                    _fail(p, is_object
+                          ? "expected ',' or '}' after an object member"
+                          : "expected ',' or ']' after an array element");
+                }
+            }
+        }
+        _check(is_object ? handler.EndObject(count) : handler.EndArray(count), p);
+        return p;
+    }
+
+    // Returns the position after the value.
+    template <typename Handler>
+    size_t _scalar(Handler& handler, size_t p)
+    {
+        char c = _data[p];
+        size_t after = 0;
+        if (c == '"') {
+            auto s = _string(p, after);
+            _check(handler.String(s.data(), static_cast<unsigned>(s.size()), true), p);
+        } else if (c == 't') {
+            after = _literal(p, "true");
+            _check(handler.Bool(true), p);
+        } else if (c == 'f') {
+            after = _literal(p, "false");
+            _check(handler.Bool(false), p);
+        } else if (c == 'n') {
+            after = _literal(p, "null");
+            _check(handler.Null(), p);
+        } else if (c == '-' || (c >= '0' && c <= '9')) {
+            after = _number(handler, p);
+        } else {
+            _fail(p, "invalid value");
+        }
+        return after;
+    }
+
+    bool _is_delimiter(size_t p) const
+    {
+        if (p >= _size) {
+            return true;
+        }
+        switch (_data[p]) {
+            case ' ':
+            case '\t':
+            case '\n':
+            case '\r':
+            case ',':
+            case ']':
+            case '}':
+                return true;
+        }
+        return false;
+    }
+
+    size_t _literal(size_t p, char const* word) const
+    {
+        size_t len = std::strlen(word);
+        if (_size - p < len || std::memcmp(_data + p, word, len) != 0 || !_is_delimiter(p + len)) {
+            _fail(p, "invalid value");
+        }
+        return p + len;
+    }
+
+    template <typename Handler>
+    size_t _number(Handler& handler, size_t p)
+    {
+        char const* begin = _data + p;
+        char const* end = _data + _size;
+        char const* q = begin;
+        bool minus = (*q == '-');
+        if (minus) {
+            q++;
+        }
+        auto is_digit = [&](char const* x) {
+            return x < end && *x >= '0' && *x <= '9';
+        };
+        if (!is_digit(q)) {
+            _fail(p, "invalid number");
+        }
+        if (*q == '0') {
+            q++;
+        } else {
+            while (is_digit(q)) {
+                q++;
+            }
+        }
+        bool is_integer = true;
+        if (q < end && *q == '.') {
+            is_integer = false;
+            q++;
+            if (!is_digit(q)) {
+                _fail(p, "missing fraction part in number");
+            }
+            while (is_digit(q)) {
+                q++;
+            }
+        }
+        if (q < end && (*q == 'e' || *q == 'E')) {
+            is_integer = false;
+            q++;
+            if (q < end && (*q == '+' || *q == '-')) {
+                q++;
+            }
+            if (!is_digit(q)) {
+                _fail(p, "missing exponent in number");
+            }
+            while (is_digit(q)) {
+                q++;
+            }
+        }
+        size_t after = q - _data;
+        if (!_is_delimiter(after)) {
+            _fail(p, "invalid number");
+        }
+
+        if (is_integer) {
+            uint64_t u;
+            auto r = std::from_chars(begin + minus, q, u);
+            if (r.ec == std::errc()) {
+                if (!minus) {
+                    if (u <= std::numeric_limits<unsigned>::max()) {
+                        _check(handler.Uint(static_cast<unsigned>(u)), p);
+                    } else {
+                        _check(handler.Uint64(u), p);
+                    }
+                    return after;
+                }
+                if (u <= uint64_t(1) << 63) {
+                    auto i = static_cast<int64_t>(0 - u);
+                    if (i >= std::numeric_limits<int>::min()) {
+                        _check(handler.Int(static_cast<int>(i)), p);
+                    } else {
+                        _check(handler.Int64(i), p);
+                    }
+                    return after;
+                }
+            }
+            // Too large for 64 bits; falls through to `double`.
+        }
+
+        double d;
+        auto r = std::from_chars(begin, q, d);
+        if (r.ec == std::errc::result_out_of_range) {
+            // `from_chars` leaves `d` alone on overflow and underflow; `strtod` gives
+            // infinity or zero, respectively.
+            _scratch.assign(begin, q);
+            d = std::strtod(_scratch.c_str(), nullptr);
+            if (d == std::numeric_limits<double>::infinity() || d == -std::numeric_limits<double>::infinity()) {
+                _fail(p, "number too big to be stored in double");
+            }
+        } else if (r.ec != std::errc() || r.ptr != q) {
+            _fail(p, "invalid number");
+        }
+        _check(handler.Double(d), p);
+        return after;
+    }
+
+    // The first quote, backslash or control character in [q, end), or `end`.
+    static char const* _scan_string(char const* q, char const* end)
+    {
+#ifdef __SSE2__
+        while (end - q >= 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(q));
+            __m128i special = _mm_or_si128(
+                                  _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                                               _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))),
+                                  _mm_cmpeq_epi8(_mm_max_epu8(v, _mm_set1_epi8(0x1F)), _mm_set1_epi8(0x1F)));
+            int mask = _mm_movemask_epi8(special);
+            if (mask) {
+                return q + __builtin_ctz(mask);
+            }
+            q += 16;
+        }
+#endif
+        while (q < end && *q != '"' && *q != '\\' && static_cast<unsigned char>(*q) >= 0x20) {
+            q++;
+        }
+        return q;
+    }
+
+    // The first bracket or quote in [q, end), or `end`.
+    static char const* _scan_brackets(char const* q, char const* end)
+    {
+#ifdef __SSE2__
+        while (end - q >= 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(q));
+            __m128i b = _mm_or_si128(v, _mm_set1_epi8(0x20));
+            __m128i special = _mm_or_si128(
+                                  _mm_or_si128(_mm_cmpeq_epi8(b, _mm_set1_epi8('{')),
+                                               _mm_cmpeq_epi8(b, _mm_set1_epi8('}'))),
+                                  _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+            int mask = _mm_movemask_epi8(special);
+            if (mask) {
+                return q + __builtin_ctz(mask);
+            }
+            q += 16;
+        }
+#endif
+        while (q < end && *q != '"' && *q != '{' && *q != '}' && *q != '[' && *q != ']') {
+            q++;
+        }
+        return q;
+    }
+
+    // Position after the array or object that starts at `p`, found by matching brackets
+    // outside of strings. The contents are not validated.
+    size_t _skip_container(size_t p) const
+    {
+        char const* end = _data + _size;
+        char const* q = _data + p;
+        size_t depth = 0;
+        while ((q = _scan_brackets(q, end)) < end) {
+            char c = *q;
+            if (c == '"') {
+                q = _skip_string(q, end);
+                continue;
+            }
+            if (c == '{' || c == '[') {
+                depth++;
+            } else if (--depth == 0) {
+                return q + 1 - _data;
+            }
+            q++;
+        }
+        _fail(p, "missing closing bracket");
+    }
+
+    // Pointer after the string that starts at `q`.
+    char const* _skip_string(char const* q, char const* end) const
+    {
+        char const* begin = q;
+        q++;
+        while ((q = _scan_string(q, end)) < end) {
+            if (*q == '"') {
+                return q + 1;
+            }
+            q += (*q == '\\') ? 2 : 1;
+        }
+        _fail(begin - _data, "missing closing quote of string");
+    }
+
+    size_t _skip_space(size_t p) const
+    {
+        while (p < _size && (_data[p] == ' ' || _data[p] == '\t' || _data[p] == '\n' || _data[p] == '\r')) {
+            p++;
+        }
+        return p;
+    }
+
+    // The unescaped content of the string whose opening quote is at `p`.
+    // Points into the input if there is nothing to unescape, else into `_scratch`.
+    // `after` receives the position after the closing quote.
+    std::string_view _string(size_t p, size_t& after)
+    {
+        char const* begin = _data + p + 1;
+        char const* end = _data + _size;
+        char const* q = _scan_string(begin, end);
+        if (q < end && *q == '"') {
+            after = q + 1 - _data;
+            return std::string_view(begin, q - begin);
+        }
+
+        _scratch.assign(begin, q);
+        while (true) {
+            if (q >= end) {
+                _fail(p, "missing closing quote of string");
+            }
+            char c = *q;
+            if (c == '"') {
+                after = q + 1 - _data;
+                break;
+            }
+            if (static_cast<unsigned char>(c) < 0x20) {
+                _fail(q - _data, "invalid character in string");
+            }
+            if (c != '\\') {
+                _scratch.push_back(c);
+                q++;
+                continue;
+            }
+            if (end - q < 2) {
+                _fail(q - _data, "invalid escape in string");
+            }
+            switch (q[1]) {
+                case '"':
+                case '\\':
+                case '/':
+                    _scratch.push_back(q[1]);
+                    break;
+                case 'b':
+                    _scratch.push_back('\b');
+                    break;
+                case 'f':
+                    _scratch.push_back('\f');
+                    break;
+                case 'n':
+                    _scratch.push_back('\n');
+                    break;
+                case 'r':
+                    _scratch.push_back('\r');
+                    break;
+                case 't':
+                    _scratch.push_back('\t');
+                    break;
+                case 'u': {
+                    uint32_t code = _hex4(q + 2);
+                    q += 6;
+                    if (code >= 0xD800 && code <= 0xDBFF) {
+                        if (end - q < 6 || q[0] != '\\' || q[1] != 'u') {
+                            _fail(q - _data, "missing low surrogate in string");
+                        }
+                        uint32_t low = _hex4(q + 2);
+                        if (low < 0xDC00 || low > 0xDFFF) {
+                            _fail(q - _data, "invalid low surrogate in string");
+                        }
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        q += 6;
+                    } else if (code >= 0xDC00 && code <= 0xDFFF) {
+                        _fail(q - 6 - _data, "unpaired low surrogate in string");
+                    }
+                    _append_utf8(code);
+                    continue;
+                }
+                default:
+                    _fail(q - _data, "invalid escape in string");
+            }
+            q += 2;
+        }
+        return std::string_view(_scratch);
+    }
+
+    uint32_t _hex4(char const* x) const
+    {
+        if (_data + _size - x < 4) {
+            _fail(x - _data, "invalid unicode escape in string");
+        }
+        uint32_t code = 0;
+        for (int k = 0; k < 4; k++) {
+            char c = x[k];
+            code <<= 4;
+            if (c >= '0' && c <= '9') {
+                code |= c - '0';
+            } else if (c >= 'a' && c <= 'f') {
+                code |= c - 'a' + 10;
+            } else if (c >= 'A' && c <= 'F') {
+                code |= c - 'A' + 10;
+            } else {
+                _fail(x - _data, "invalid unicode escape in string");
+            }
+        }
+        return code;
+    }
+
+    void _append_utf8(uint32_t code)
+    {
+        if (code < 0x80) {
+            _scratch.push_back(static_cast<char>(code));
+        } else if (code < 0x800) {
+            _scratch.push_back(static_cast<char>(0xC0 | (code >> 6)));
+            _scratch.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        } else if (code < 0x10000) {
+            _scratch.push_back(static_cast<char>(0xE0 | (code >> 12)));
+            _scratch.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+            _scratch.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        } else {
+            _scratch.push_back(static_cast<char>(0xF0 | (code >> 18)));
+            _scratch.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+            _scratch.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+            _scratch.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        }
+    }
+
+    void _check(bool ok, size_t p) const
+    {
+        if (!ok) {
+            _fail(p, "terminated by the handler");
+        }
+    }
+
+    [[noreturn]] void _fail(size_t p, char const* msg) const
+    {
+        throw Error(make_string("failed to parse JSON at offset ", p, ": ", msg));
+    }
+};
+
+} // namespace zpz
+
+#endif // _zpz_utilities_json_simd_h_
@@ -0,0 +1,235 @@
+#ifndef _zpz_utilities_json_writer_h_
+#define _zpz_utilities_json_writer_h_
+
+#include <charconv>
+#include <cmath>
+#include <map>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace zpz
+{
+
+class JsonWriter
+{
+    // Serializes values and containers to JSON text in a buffer that is reused
+    // across documents:
+    //
+    //    JsonWriter writer;
+    //    for (...) {
+    //        writer.clear();
+    //        writer.write(scores);   // e.g. std::map<std::string, std::vector<double>>
+    //        send(writer.view());
+    //    }
+    //
+    // Supported are `bool`, integers, floating-point numbers, strings, and `std::vector`,
+    // `std::pair` (as an array of two), `std::map` and `std::unordered_map` of these,
+    // nested to any depth. Map keys are strings or numbers; numbers are quoted.
+    //
+    // Numbers are formatted by `std::to_chars`, which gives the shortest text
+    // that parses back to the same value. NaN and infinity, which JSON can not represent,
+    // are written as `null`. Strings are escaped as JSON requires; other bytes,
+    // including UTF-8 sequences, are copied as is.
+    //
+    // The output has no whitespace.
+
+  public:
+    explicit JsonWriter(size_t capacity = 4096)
+    {
+        _buffer.reserve(capacity);
+    }
+
+    // Append `x` to the buffer.
+    template <typename T>
+    JsonWriter& write(T const& x)
+    {
+        _write(x);
+        return *this;
+    }
+
+    // Empty the buffer, keeping its memory.
+    void clear()
+    {
+        _buffer.clear();
+    }
+
+    std::string_view view() const
+    {
+        return _buffer;
+    }
+
+    std::string const& str() const
+    {
+        return _buffer;
+    }
+
+    char const* data() const
+    {
+        return _buffer.data();
+    }
+
+    size_t size() const
+    {
+        return _buffer.size();
+    }
+
+  private:
+    std::string _buffer;
+
+    void _write(bool x)
+    {
+        if (x) {
+            _buffer.append("true", 4);
+        } else {
+            _buffer.append("false", 5);
+        }
+    }
+
+    template <typename T>
+    std::enable_if_t<std::is_arithmetic<T>::value> _write(T x)
+    {
+        if constexpr (std::is_floating_point<T>::value) {
+            if (!std::isfinite(x)) {
+                _buffer.append("null", 4);
+                return;
+            }
+        }
+        char buf[32];
+        auto r = std::to_chars(buf, buf + sizeof(buf), x);
+        _buffer.append(buf, r.ptr - buf);
+    }
+
+    void _write(std::string_view x)
+    {
+        _buffer.push_back('"');
+        // Copy runs of characters that need no escaping in one go.
+        size_t run = 0;
+        for (size_t i = 0; i < x.size(); i++) {
+            auto c = static_cast<unsigned char>(x[i]);
+            if (c >= 0x20 && c != '"' && c != '\\') {
+                continue;
+            }
+            _buffer.append(x.data() + run, i - run);
+            run = i + 1;
+            _escape(c);
+        }
+        _buffer.append(x.data() + run, x.size() - run);
+        _buffer.push_back('"');
+    }
+
+    void _write(std::string const& x)
+    {
+        _write(std::string_view(x));
+    }
+
+    void _write(char const* x)
+    {
+        _write(std::string_view(x));
+    }
+
+    template <typename T, typename A>
+    void _write(std::vector<T, A> const& x)
+    {
+        _buffer.push_back('[');
+        bool first = true;
+        for (auto const& v : x) {
+            if (!first) {
+                _buffer.push_back(',');
+            }
+            first = false;
+            _write(v);
+        }
+        _buffer.push_back(']');
+    }
+
+    template <typename S, typename T>
+    void _write(std::pair<S, T> const& x)
+    {
+        _buffer.push_back('[');
+        _write(x.first);
+        _buffer.push_back(',');
+        _write(x.second);
+        _buffer.push_back(']');
+    }
+
+    template <typename K, typename V, typename C, typename A>
+    void _write(std::map<K, V, C, A> const& x)
+    {
+        _write_object(x);
+    }
+
+    template <typename K, typename V, typename H, typename E, typename A>
+    void _write(std::unordered_map<K, V, H, E, A> const& x)
+    {
+        _write_object(x);
+    }
+
+    template <typename M>
+    void _write_object(M const& x)
+    {
+        _buffer.push_back('{');
+        bool first = true;
+        for (auto const& [k, v] : x) {
+            if (!first) {
+                _buffer.push_back(',');
+            }
+            first = false;
+            _write_key(k);
+            _buffer.push_back(':');
+            _write(v);
+        }
+        _buffer.push_back('}');
+    }
+
+    template <typename K>
+    void _write_key(K const& k)
+    {
+        if constexpr (std::is_arithmetic<K>::value) {
+            _buffer.push_back('"');
+            _write(k);
+            _buffer.push_back('"');
+        } else {
+            _write(k);
+        }
+    }
+
+    void _escape(unsigned char c)
+    {
+        switch (c) {
+            case '"':
+                _buffer.append("\\\"", 2);
+                break;
+            case '\\':
+                _buffer.append("\\\\", 2);
+                break;
+            case '\b':
+                _buffer.append("\\b", 2);
+                break;
+            case '\f':
+                _buffer.append("\\f", 2);
+                break;
+            case '\n':
+                _buffer.append("\\n", 2);
+                break;
+            case '\r':
+                _buffer.append("\\r", 2);
+                break;
+            case '\t':
+                _buffer.append("\\t", 2);
+                break;
+            default: {
+                char const* hex = "0123456789abcdef";
+                char u[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+                _buffer.append(u, 6);
+            }
+        }
+    }
+};
+
+} // namespace zpz
+
+#endif // _zpz_utilities_json_writer_h_
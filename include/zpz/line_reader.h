@@ -0,0 +1,341 @@
+#ifndef _zpz_utilities_line_reader_h_
+#define _zpz_utilities_line_reader_h_
+
+#include "exception.h"
+#include "gzip.h"
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace zpz
+{
+
+class LineRange
+{
+    // The lines of the text in a buffer, as views into the buffer:
+    //
+    //    LineRange lines(text.data(), text.size());
+    //    std::string_view line;
+    //    while (lines.next(line)) {
+    //        ...
+    //    }
+    //
+    // Lines are split at '\n', which is not part of the line; anything else,
+    // including '\r', is. The text after the last '\n', if not empty, is the last line,
+    // unless `final` is `false`, which means that more text is to come: then it is left
+    // as the `remainder`.
+    //
+    // Newlines are located 64 bytes at a time: SSE2 comparisons give a bitmask of
+    // the newlines in a block, which is then consumed one bit per line. Hence the cost
+    // is a few instructions per 64 bytes plus a few per line, without a call per line.
+
+  public:
+    LineRange() = default;
+
+    LineRange(char const* data, size_t size, bool final = true)
+        : _data(data)
+        , _size(size)
+        , _final(final)
+    {
+        if (_size > 0) {
+            _mask = _newlines(0);
+        }
+    }
+
+    // Returns `false` if there are no more lines.
+    bool next(std::string_view& line)
+    {
+        if (_pos >= _size) {
+            return false;
+        }
+        size_t end = _next_newline();
+        if (end == _size && !_final) {
+            return false;
+        }
+        line = std::string_view(_data + _pos, end - _pos);
+        _pos = end + 1;
+        return true;
+    }
+
+    // The text that has not been returned as lines.
+    std::string_view remainder() const
+    {
+        return std::string_view(_data + std::min(_pos, _size), _size - std::min(_pos, _size));
+    }
+
+    // Split the remaining text into at most `n` ranges of whole lines, of similar sizes,
+    // e.g. to process them on `n` threads.
+    std::vector<LineRange> split(size_t n) const
+    {
+        std::vector<LineRange> z;
+        size_t start = std::min(_pos, _size);
+        size_t begin = start;
+        for (size_t k = 1; k <= n && begin < _size; k++) {
+            size_t end = _size;
+            if (k < n) {
+                size_t target = std::max(begin, start + (_size - start) / n * k);
+                auto nl = static_cast<char const*>(std::memchr(_data + target, '\n', _size - target));
+                end = nl ? nl - _data + 1 : _size;
+            }
+            z.emplace_back(_data + begin, end - begin, end < _size || _final);
+            begin = end;
+        }
+        return z;
+    }
+
+    char const* data() const
+    {
+        return _data;
+    }
+
+    size_t size() const
+    {
+        return _size;
+    }
+
+  private:
+    char const* _data = nullptr;
+    size_t _size = 0;
+    bool _final = true;
+    // Start of the next line.
+    size_t _pos = 0;
+    // Offset of the current block, and its newlines that have not been consumed.
+    size_t _block = 0;
+    uint64_t _mask = 0;
+
+    // Position of the first newline at or after `_pos`, or `_size` if there is none.
+    // Newlines are consumed in order, and `_pos` is right after the last one consumed.
+    size_t _next_newline()
+    {
+        while (!_mask) {
+            _block += 64;
+            if (_block >= _size) {
+                _block = _size;
+                return _size;
+            }
+            _mask = _newlines(_block);
+        }
+        size_t p = _block + __builtin_ctzll(_mask);
+        _mask &= _mask - 1;
+        return p;
+    }
+
+    // Bitmask of the newlines in the block at `offset`.
+    uint64_t _newlines(size_t offset) const
+    {
+        char const* p = _data + offset;
+        size_t n = _size - offset;
+#ifdef __SSE2__
+        if (n >= 64) {
+            __m128i const nl = _mm_set1_epi8('\n');
+            auto match = [&](int i) {
+                __m128i x = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + 16 * i));
+                return static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, nl))));
+            };
+            return match(0) | (match(1) << 16) | (match(2) << 32) | (match(3) << 48);
+        }
+#endif
+        uint64_t mask = 0;
+        for (size_t i = 0, m = std::min<size_t>(n, 64); i < m; i++) {
+            if (p[i] == '\n') {
+                mask |= uint64_t(1) << i;
+            }
+        }
+        return mask;
+    }
+};
+
+
+class LineReader
+{
+    // Reads a text file line by line, e.g. a TSV or log file of many GB:
+    //
+    //    LineReader reader("access.log");
+    //    std::string_view line;
+    //    while (reader.next(line)) {
+    //        ...
+    //    }
+    //
+    // A regular file is memory-mapped (see `MappedFile`), and its lines are views
+    // into the map, valid as long as the reader. Nothing is copied or allocated per line.
+    // See `LineRange` for how lines are split.
+    //
+    // Other files, such as pipes, and any other source given as a function that reads
+    // into a buffer, are read in chunks of `chunk_size` bytes. So are gzip-compressed
+    // files, which are decompressed on another thread (see `GzipReader`). Then a line
+    // is valid until the next call to `next`; a line longer than a chunk makes
+    // the buffer grow.
+    //
+    // A mapped file can also be read on multiple threads, in ranges of whole lines
+    // (see `for_each_line`).
+
+  public:
+    // Fills `buffer` with up to `size` bytes and returns their number; 0 at the end.
+    using Source = std::function<size_t(char* buffer, size_t size)>;
+
+    explicit LineReader(std::string const& filename, size_t chunk_size = 4 * 1024 * 1024)
+    {
+        struct stat sb;
+        if (::stat(filename.c_str(), &sb) == 0 && S_ISREG(sb.st_mode)) {
+            _file = MappedFile(filename, MADV_SEQUENTIAL);
+            if (!is_gzip(_file.view())) {
+                _lines = LineRange(_file.data(), _file.size());
+                return;
+            }
+            _gzip.reset(new GzipReader(std::move(_file), true));
+            _source = [this](char* buffer, size_t size) {
+                return _gzip->read(buffer, size);
+            };
+            _start_chunks(chunk_size);
+            return;
+        }
+        _fd = ::open(filename.c_str(), O_RDONLY);
+        if (_fd < 0) {
+            throw Error("could not open file '" + filename + "': " + std::strerror(errno));
+        }
+        _source = [this, filename](char* buffer, size_t size) {
+            while (true) {
+                ssize_t n = ::read(_fd, buffer, size);
+                if (n >= 0) {
+                    return static_cast<size_t>(n);
+                }
+                if (errno != EINTR) {
+                    throw Error("could not read file '" + filename + "': " + std::strerror(errno));
+                }
+            }
+        };
+        _start_chunks(chunk_size);
+    }
+
+    explicit LineReader(Source source, size_t chunk_size = 4 * 1024 * 1024)
+        : _source(std::move(source))
+    {
+        _start_chunks(chunk_size);
+    }
+
+    // The lines are views into the reader, which hence must not move.
+    LineReader(LineReader const&) = delete;
+    LineReader& operator=(LineReader const&) = delete;
+
+    ~LineReader()
+    {
+        if (_fd >= 0) {
+            ::close(_fd);
+        }
+    }
+
+    // Returns `false` if there are no more lines.
+    bool next(std::string_view& line)
+    {
+        while (!_lines.next(line)) {
+            if (!_source || _eof) {
+                return false;
+            }
+            _fill();
+        }
+        return true;
+    }
+
+    // Call `f(i, line)` for each remaining line, on `n_threads` threads (default is
+    // the number of cores), each of which takes one range of whole lines of about
+    // equal size. `i` is the index of the range, from 0 up to `n_threads`,
+    // e.g. to collect results per thread without locking. Within a range, lines
+    // come in order.
+    //
+    // The file must be mapped, that is, a regular file that is not compressed. Throws the first exception
+    // thrown by `f`, after all threads have finished.
+    template <typename F>
+    void for_each_line(F f, size_t n_threads = 0)
+    {
+        if (_source) {
+            throw Error("only a memory-mapped file can be read on multiple threads");
+        }
+        if (n_threads == 0) {
+            n_threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        auto ranges = _lines.split(n_threads);
+        _lines = LineRange();
+
+        std::mutex mutex;
+        std::exception_ptr error;
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < ranges.size(); i++) {
+            workers.emplace_back([&, i] {
+                try {
+                    std::string_view line;
+                    while (ranges[i].next(line)) {
+                        f(i, line);
+                    }
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                }
+            });
+        }
+        for (auto& t : workers) {
+            t.join();
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+  private:
+    MappedFile _file;
+    std::unique_ptr<GzipReader> _gzip;
+    LineRange _lines;
+    int _fd = -1;
+    Source _source;
+    std::unique_ptr<char[]> _buffer;
+    size_t _capacity = 0;
+    bool _eof = false;
+
+    void _start_chunks(size_t chunk_size)
+    {
+        _capacity = std::max<size_t>(chunk_size, 4096);
+        _buffer.reset(new char[_capacity]);
+        _lines = LineRange(_buffer.get(), 0, false);
+    }
+
+    // Move the incomplete last line to the front of the buffer, growing it if
+    // the line fills it, and read the next chunk after it.
+    void _fill()
+    {
+        auto rest = _lines.remainder();
+        if (rest.size() == _capacity) {
+            std::unique_ptr<char[]> bigger(new char[_capacity * 2]);
+            std::memcpy(bigger.get(), rest.data(), rest.size());
+            _buffer = std::move(bigger);
+            _capacity *= 2;
+        } else {
+            std::memmove(_buffer.get(), rest.data(), rest.size());
+        }
+        size_t n = _source(_buffer.get() + rest.size(), _capacity - rest.size());
+        _eof = (n == 0);
+        _lines = LineRange(_buffer.get(), rest.size() + n, _eof);
+    }
+};
+
+} // namespace zpz
+#endif // _zpz_utilities_line_reader_h_
@@ -0,0 +1,259 @@
+#ifndef _zpz_utilities_mapped_file_h_
+#define _zpz_utilities_mapped_file_h_
+
+#include "exception.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace zpz
+{
+
+class MappedFile
+{
+    // Memory map of an entire file.
+    //
+    // The content is read through the page cache without being copied into
+    // the process, and processes mapping the same file share the pages.
+    // `advice` is passed to `madvise`; by default the kernel is told that the file
+    // will be read sequentially, so that it reads ahead aggressively.
+    //
+    // If `writable` is `true`, the map is private and copy-on-write: the content
+    // can be modified through `mutable_data`, which copies only the modified pages
+    // and never changes the file. In this mode the content is followed by a zero byte,
+    // so that it can be used as a null-terminated string.
+    //
+    // If `populate` is `true`, the whole file is read into the page cache and mapped
+    // up front (`MAP_POPULATE`), instead of page by page on first access. This suits
+    // content that will be read in full right away, e.g. to be parsed or copied.
+    //
+    // Empty files and files that can not be mapped, such as pipes and files in /proc,
+    // are read into a buffer instead, which is followed by a zero byte as well;
+    // `is_mapped` tells.
+
+  public:
+    MappedFile() = default;
+
+    explicit MappedFile(std::string const& filename,
+                        int advice = MADV_SEQUENTIAL,
+                        bool writable = false,
+                        bool populate = false)
+        : _writable(writable)
+    {
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw Error("could not open file '" + filename + "': " + std::strerror(errno));
+        }
+        struct stat sb;
+        if (::fstat(fd, &sb) != 0) {
+            auto e = errno;
+            ::close(fd);
+            throw Error("could not stat file '" + filename + "': " + std::strerror(e));
+        }
+        // Files in /proc and the like claim to be empty; they are read to the end.
+        bool regular = S_ISREG(sb.st_mode) && sb.st_size > 0;
+        if (regular) {
+            _size = sb.st_size;
+        }
+        if (!(regular && _map(fd, populate)) && !_read(fd, regular)) {
+            auto e = errno;
+            ::close(fd);
+            throw Error("could not read file '" + filename + "': " + std::strerror(e));
+        }
+        ::close(fd);
+
+        advise(advice);
+    }
+
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept
+    {
+        _take(other);
+    }
+
+    MappedFile& operator=(MappedFile&& other) noexcept
+    {
+        if (this != &other) {
+            _unmap();
+            _take(other);
+        }
+        return *this;
+    }
+
+    ~MappedFile()
+    {
+        _unmap();
+    }
+
+    char const* data() const
+    {
+        return _data;
+    }
+
+    std::byte const* bytes() const
+    {
+        return reinterpret_cast<std::byte const*>(_data);
+    }
+
+    std::string_view view() const
+    {
+        return std::string_view(_data, _size);
+    }
+
+    // Only available if the file was mapped `writable`.
+    char* mutable_data()
+    {
+        if (!_writable) {
+            throw Error("the file is not mapped writable");
+        }
+        return _data;
+    }
+
+    size_t size() const
+    {
+        return _size;
+    }
+
+    bool empty() const
+    {
+        return _size == 0;
+    }
+
+    // `false` if the file was read into a buffer.
+    bool is_mapped() const
+    {
+        return _addr != nullptr;
+    }
+
+    // Pass a hint such as `MADV_SEQUENTIAL`, `MADV_RANDOM`, `MADV_WILLNEED`
+    // or `MADV_DONTNEED` about the whole mapping to the kernel.
+    // Hints are advisory, hence failure is ignored.
+    void advise(int advice) const
+    {
+        if (_addr) {
+            ::madvise(_addr, _map_size, advice);
+        }
+    }
+
+  private:
+    void* _addr = nullptr;
+    char* _data = nullptr;
+    size_t _size = 0;
+    size_t _map_size = 0;
+    std::unique_ptr<char[]> _buffer;
+    bool _writable = false;
+
+    // Map the first `_size` bytes of `fd`, which is not empty. Returns `false`, with `errno` set, on failure.
+    bool _map(int fd, bool populate)
+    {
+        int prot = _writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+        int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+        if (populate) {
+            flags |= MAP_POPULATE;
+        }
+#else
+        (void)populate;
+#endif
+        void* addr = MAP_FAILED;
+        size_t map_size = _size;
+        if (_writable) {
+            // Reserve room for the content plus the terminating zero in anonymous
+            // (hence zero-filled) memory, then map the file over the front of it.
+            // This works whether or not the file size is a multiple of the page size.
+            map_size = _size + 1;
+            addr = ::mmap(nullptr, map_size, prot, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (addr != MAP_FAILED) {
+                if (::mmap(addr, _size, prot, flags | MAP_FIXED, fd, 0) == MAP_FAILED) {
+                    auto e = errno;
+                    ::munmap(addr, map_size);
+                    errno = e;
+                    addr = MAP_FAILED;
+                }
+            }
+        } else {
+            addr = ::mmap(nullptr, map_size, prot, flags, fd, 0);
+        }
+        if (addr == MAP_FAILED) {
+            return false;
+        }
+        _addr = addr;
+        _map_size = map_size;
+        _data = static_cast<char*>(addr);
+        return true;
+    }
+
+    // Read the file into `_buffer`. A regular file is read by `pread` into a buffer
+    // of its size; anything else is read to the end into a buffer that grows as needed.
+    // Returns `false`, with `errno` set, on failure.
+    bool _read(int fd, bool regular)
+    {
+        size_t capacity = regular ? _size + 1 : 64 * 1024;
+        _buffer.reset(new char[capacity]);
+        size_t n = 0;
+        while (!regular || n < _size) {
+            if (n + 1 == capacity) {
+                std::unique_ptr<char[]> bigger(new char[capacity * 2]);
+                std::memcpy(bigger.get(), _buffer.get(), n);
+                _buffer = std::move(bigger);
+                capacity *= 2;
+            }
+            ssize_t k = regular
+                        ? ::pread(fd, _buffer.get() + n, capacity - 1 - n, n)
+                        : ::read(fd, _buffer.get() + n, capacity - 1 - n);
+            if (k < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                _buffer.reset();
+                return false;
+            }
+            if (k == 0) {
+                break;
+            }
+            n += k;
+        }
+        _buffer[n] = '\0';
+        _size = n;
+        _data = _buffer.get();
+        return true;
+    }
+
+    void _take(MappedFile& other)
+    {
+        _addr = other._addr;
+        _data = other._data;
+        _size = other._size;
+        _map_size = other._map_size;
+        _buffer = std::move(other._buffer);
+        _writable = other._writable;
+        other._addr = nullptr;
+        other._data = nullptr;
+        other._size = 0;
+        other._map_size = 0;
+    }
+
+    void _unmap()
+    {
+        if (_addr) {
+            ::munmap(_addr, _map_size);
+            _addr = nullptr;
+        }
+        _buffer.reset();
+        _data = nullptr;
+    }
+};
+
+} // namespace zpz
+#endif // _zpz_utilities_mapped_file_h_
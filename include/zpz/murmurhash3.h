@@ -42,8 +42,8 @@ inline uint32_t fmix32(uint32_t h)
     return h;
 }
 
-void MurmurHash3_x86_32(const void* key, int len,
-                        uint32_t seed, void* out)
+inline void MurmurHash3_x86_32(const void* key, int len,
+                               uint32_t seed, void* out)
 {
     const uint8_t* data = (const uint8_t*)key;
     const int nblocks = len / 4;
@@ -82,7 +82,7 @@ void MurmurHash3_x86_32(const void* key, int len,
     *(uint32_t*)out = h1;
 }
 
-int32_t murmurhash3_32(char const* key, int len, int seed = 0)
+inline int32_t murmurhash3_32(char const* key, int len, int seed = 0)
 {
     /*
     key : bytes or string encoded as bytes.
@@ -102,7 +102,7 @@ int32_t murmurhash3_32(char const* key, int len, int seed = 0)
 // see
 //   sklearn.feature_extraction.hashing.FeatureHasher
 //   sklearn.feature_extraction._hashing.transform
-std::pair<int, int> hash(char const* name, int len, int n_out)
+inline std::pair<int, int> hash(char const* name, int len, int n_out)
 {
     // Returns index and sign.
     auto h = murmurhash3_32(name, len);
@@ -0,0 +1,99 @@
+#ifndef _zpz_utilities_queue_h_
+#define _zpz_utilities_queue_h_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace zpz
+{
+
+template <typename T>
+class BlockingQueue
+{
+    // A bounded, thread-safe FIFO queue for handing work between threads.
+    //
+    // `push` blocks while the queue is full; `pop` blocks while the queue is empty.
+    // After `close` is called, `push` fails, and `pop` returns the remaining items
+    // and then fails. This is how consumers learn that no more work is coming.
+
+  public:
+    explicit BlockingQueue(size_t capacity)
+        : _capacity(capacity > 0 ? capacity : 1)
+    {
+    }
+
+    // Returns `false` if the queue has been closed, in which case `x` is not enqueued.
+    bool push(T x)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _not_full.wait(lock, [this] {
+            return _closed || _items.size() < _capacity;
+        });
+        if (_closed) {
+            return false;
+        }
+        _items.push_back(std::move(x));
+        lock.unlock();
+        _not_empty.notify_one();
+        return true;
+    }
+
+    // Returns `false` if the queue has been closed and is empty.
+    bool pop(T& x)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _not_empty.wait(lock, [this] {
+            return _closed || !_items.empty();
+        });
+        if (_items.empty()) {
+            return false;
+        }
+        x = std::move(_items.front());
+        _items.pop_front();
+        lock.unlock();
+        _not_full.notify_one();
+        return true;
+    }
+
+    // Like `pop`, but returns `false` right away, rather than blocking, if the queue is empty.
+    bool try_pop(T& x)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_items.empty()) {
+            return false;
+        }
+        x = std::move(_items.front());
+        _items.pop_front();
+        lock.unlock();
+        _not_full.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _closed = true;
+        }
+        _not_full.notify_all();
+        _not_empty.notify_all();
+    }
+
+    bool closed() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _closed;
+    }
+
+  private:
+    size_t _capacity;
+    bool _closed = false;
+    std::deque<T> _items;
+    mutable std::mutex _mutex;
+    std::condition_variable _not_full;
+    std::condition_variable _not_empty;
+};
+
+} // namespace zpz
+#endif // _zpz_utilities_queue_h_
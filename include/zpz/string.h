@@ -10,7 +10,7 @@
 namespace zpz
 {
 
-std::string random_string(std::size_t length)
+inline std::string random_string(std::size_t length)
 {
     static auto& chrs = "0123456789"
                         "abcdefghijklmnopqrstuvwxyz"
@@ -38,19 +38,19 @@ std::string make_string(T x)
 }
 
 template <>
-std::string make_string(std::string x)
+inline std::string make_string(std::string x)
 {
     return x;
 }
 
 template <>
-std::string make_string(std::string_view x)
+inline std::string make_string(std::string_view x)
 {
     return std::string(x);
 }
 
 template <>
-std::string make_string(char const* x)
+inline std::string make_string(char const* x)
 {
     return std::string(x);
 }
@@ -0,0 +1,67 @@
+#include "zpz/avro.h"
+#include "zpz/timer.h"
+
+#include <iostream>
+
+using namespace zpz;
+
+// Compares decoding all records of an Avro file through the generic `AvroReader`
+// against the struct binding of `AvroStructReader`.
+// The records are expected to have fields 'coef' (array of double) and 'intercept' (double),
+// like the file used by `test_avro`.
+
+struct Model {
+    std::vector<double> coef;
+    double intercept;
+};
+
+
+int main(int argc, char const * const * argv)
+{
+    (void)argc;
+    Timer timer;
+
+    timer.start();
+    size_t n_generic = 0;
+    double total_generic = 0.;
+    {
+        auto reader = AvroReader(argv[1]);
+        auto coef = reader.make_path("coef");
+        auto intercept = reader.make_path("intercept");
+        for (auto& record : reader.records()) {
+            auto v = record.get_vector<double>(coef);
+            total_generic += record.get_scalar<double>(intercept) + v.size();
+            n_generic++;
+        }
+    }
+    timer.stop();
+    auto t_generic = timer.milliseconds();
+
+    timer.start();
+    size_t n_struct = 0;
+    double total_struct = 0.;
+    {
+        auto binding = AvroStructBinding<Model>()
+                       .field("coef", &Model::coef)
+                       .field("intercept", &Model::intercept);
+        AvroStructReader<Model> reader(argv[1], binding);
+        Model m;
+        while (reader.read(m)) {
+            total_struct += m.intercept + m.coef.size();
+            n_struct++;
+        }
+    }
+    timer.stop();
+    auto t_struct = timer.milliseconds();
+
+    std::cout << "AvroReader:       " << n_generic << " records in " << t_generic << " ms" << std::endl;
+    std::cout << "AvroStructReader: " << n_struct << " records in " << t_struct << " ms" << std::endl;
+    if (t_struct > 0) {
+        std::cout << "speed-up: " << t_generic / t_struct << std::endl;
+    }
+    if (n_generic != n_struct || total_generic != total_struct) {
+        std::cout << "FAIL: the two readers disagree" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,36 @@
+#include "zpz/file_loader.h"
+#include "zpz/io.h"
+#include "zpz/timer.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace zpz;
+
+// Compares reading the files given as arguments one after another by `read_text_file`
+// against reading them concurrently by `read_files`. Run it twice to compare
+// on a cold and a warm page cache.
+
+
+int main(int argc, char const * const * argv)
+{
+    std::vector<std::string> filenames(argv + 1, argv + argc);
+    Timer timer;
+
+    timer.start();
+    size_t n_sequential = 0;
+    for (auto const& f : filenames) {
+        n_sequential += read_text_file(f).size();
+    }
+    timer.stop();
+    std::cout << "read_text_file: " << n_sequential << " bytes in " << timer.milliseconds() << " ms" << std::endl;
+
+    timer.start();
+    size_t n_concurrent = 0;
+    for (auto const& content : read_files(filenames)) {
+        n_concurrent += content.size();
+    }
+    timer.stop();
+    std::cout << "read_files: " << n_concurrent << " bytes in " << timer.milliseconds() << " ms" << std::endl;
+}
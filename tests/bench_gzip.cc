@@ -0,0 +1,41 @@
+#include "zpz/gzip.h"
+#include "zpz/timer.h"
+
+#include <iostream>
+#include <string>
+#include <string_view>
+
+using namespace zpz;
+
+// Compares decompressing the gzip file given as argument by `GzipReader`, without
+// and with a thread that decompresses ahead, and by `read_gzip_file` into one string.
+// The rates are of decompressed bytes.
+
+
+int main(int argc, char const * const * argv)
+{
+    (void)argc;
+    std::string filename = argv[1];
+    Timer timer;
+
+    for (bool threaded : {false, true}) {
+        timer.start();
+        size_t n = 0;
+        {
+            GzipReader in(filename, threaded);
+            std::string_view chunk;
+            while (in.next(chunk)) {
+                n += chunk.size();
+            }
+        }
+        timer.stop();
+        std::cout << "GzipReader (threaded: " << threaded << "): " << n << " bytes, "
+                  << n / timer.seconds() / 1e6 << " MB/s" << std::endl;
+    }
+
+    timer.start();
+    auto n = read_gzip_file(filename).size();
+    timer.stop();
+    std::cout << "read_gzip_file: " << n << " bytes, " << n / timer.seconds() / 1e6 << " MB/s" << std::endl;
+    return 0;
+}
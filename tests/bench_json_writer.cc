@@ -0,0 +1,44 @@
+#include "zpz/io.h"
+#include "zpz/json_writer.h"
+#include "zpz/timer.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace zpz;
+
+// Compares writing a map of 100 vectors of 1000 doubles by the stream operators
+// of io.h against `JsonWriter`.
+
+
+int main()
+{
+    std::map<std::string, std::vector<double>> m;
+    for (int i = 0; i < 100; i++) {
+        std::vector<double> v;
+        for (int j = 0; j < 1000; j++) {
+            v.push_back(std::rand() / 1000.0);
+        }
+        m["key" + std::to_string(i)] = v;
+    }
+
+    Timer timer;
+    timer.start();
+    std::ostringstream ss;
+    for (auto const& [k, v] : m) {
+        ss << k << v;
+    }
+    timer.stop();
+    std::cout << "ostream: " << ss.str().size() << " bytes in " << timer.milliseconds() << " ms" << std::endl;
+
+    JsonWriter w;
+    timer.start();
+    w.write(m);
+    timer.stop();
+    std::cout << "JsonWriter: " << w.str().size() << " bytes in " << timer.milliseconds() << " ms" << std::endl;
+    return 0;
+}
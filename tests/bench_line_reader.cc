@@ -0,0 +1,72 @@
+#include "zpz/line_reader.h"
+#include "zpz/timer.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace zpz;
+
+// Compares counting the lines of the file given as argument by `std::getline`,
+// by `LineReader::next`, and by `LineReader::for_each_line` on all cores.
+
+
+int main(int argc, char const * const * argv)
+{
+    (void)argc;
+    std::string filename = argv[1];
+    Timer timer;
+
+    timer.start();
+    size_t n_getline = 0;
+    size_t size = 0;
+    {
+        std::ifstream f(filename, std::ios::binary);
+        std::string line;
+        while (std::getline(f, line)) {
+            size += line.size() + 1;
+            n_getline++;
+        }
+    }
+    timer.stop();
+    std::cout << "std::getline: " << n_getline << " lines, " << size / timer.seconds() / 1e9 << " GB/s" << std::endl;
+
+    timer.start();
+    size_t n_next = 0;
+    {
+        LineReader reader(filename);
+        std::string_view line;
+        while (reader.next(line)) {
+            n_next++;
+        }
+    }
+    timer.stop();
+    std::cout << "LineReader: " << n_next << " lines, " << size / timer.seconds() / 1e9 << " GB/s" << std::endl;
+
+    timer.start();
+    size_t n_parallel = 0;
+    {
+        LineReader reader(filename);
+        // One counter per range, each on a cache line of its own.
+        std::vector<size_t> counts(std::max(1u, std::thread::hardware_concurrency()) * 8);
+        reader.for_each_line([&](size_t i, std::string_view) {
+            counts[i * 8]++;
+        });
+        for (auto n : counts) {
+            n_parallel += n;
+        }
+    }
+    timer.stop();
+    std::cout << "LineReader::for_each_line: " << n_parallel << " lines, " << size / timer.seconds() / 1e9
+              << " GB/s" << std::endl;
+
+    if (n_getline != n_next || n_next != n_parallel) {
+        std::cout << "FAIL: the readers disagree" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -16,4 +16,19 @@ int main(int argc, char const * const * argv)
     std::cout << "\nintercept:\n";
     reader.seek("/", "intercept");
     std::cout << reader.get_scalar<double>() << std::endl;
+
+    auto intercept = reader.make_path("intercept");
+    size_t n = 0;
+    double total = 0.;
+    for (auto& record : reader.records()) {
+        total += record.get_scalar<double>(intercept);
+        n++;
+    }
+    std::cout << "\nnumber of records: " << n << std::endl;
+    std::cout << "\nsum of intercepts: " << total << std::endl;
+
+    auto pruned = AvroReader(argv[1], {{"intercept"}});
+    std::cout << "\nintercept, reading only this field:\n";
+    std::cout << pruned.get_scalar<double>("intercept") << std::endl;
+    std::cout << "number of fields: " << pruned.get_record_size() << std::endl;
 }
@@ -0,0 +1,440 @@
+#include "zpz/avro.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace zpz;
+
+
+// Read the intercepts of all records in parallel, and compare with a serial read.
+void test_parallel(char const* filename, int n)
+{
+    std::vector<double> expected;
+    {
+        AvroReader reader(filename);
+        for (auto& record : reader.records()) {
+            expected.push_back(record.get_scalar<double>("intercept"));
+        }
+    }
+    assert(expected.size() == size_t(n));
+
+    for (bool ordered : {true, false}) {
+        AvroParallelReader reader(filename, 4);
+        auto intercept = reader.make_path("intercept");
+        std::mutex mutex;
+        std::vector<double> values;
+        reader.for_each([&](AvroReader& record) {
+            auto x = record.get_scalar<double>(intercept);
+            std::lock_guard<std::mutex> lock(mutex);
+            values.push_back(x);
+        }, ordered);
+        if (ordered) {
+            assert(values == expected);
+        } else {
+            std::sort(values.begin(), values.end());
+            assert(values == expected);
+        }
+        std::cout << "parallel, ordered " << ordered << ": " << values.size() << " records" << std::endl;
+
+        // Stop in the middle of the file by throwing from the callback.
+        int count = 0;
+        bool thrown = false;
+        try {
+            reader.for_each([&](AvroReader&) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (++count == 100) {
+                    throw std::runtime_error("stop");
+                }
+            }, ordered);
+        } catch (std::runtime_error const& e) {
+            thrown = true;
+        }
+        assert(thrown);
+        assert(count >= 100 && count < n);
+    }
+
+    // Destroy a reader in the middle of the file.
+    {
+        AvroReader reader(filename);
+        for (int i = 0; i < 10; i++) {
+            [[maybe_unused]] bool more = reader.next();
+            assert(more);
+        }
+    }
+}
+
+
+struct Sample {
+    std::vector<double> coef;
+    double intercept = 0;
+    int n = 0;
+    std::vector<bool> flags;
+};
+
+
+// Bound members of the `i`-th record written by `test_struct_reader`.
+void check_sample(Sample const& s, int i)
+{
+    assert(s.coef.size() == size_t(i * 7 % 11));
+    for (size_t j = 0; j < s.coef.size(); j++) {
+        assert(s.coef[j] == i + j * 0.5);
+    }
+    assert(s.intercept == i * 2.0);
+    assert(s.n == -i);
+    assert(s.flags.size() == size_t(i % 4));
+    for (size_t j = 0; j < s.flags.size(); j++) {
+        assert(s.flags[j] == ((i + j) % 2 == 0));
+    }
+}
+
+
+// Read the records into one `Sample`, so that its vectors are reused, and check them.
+void read_samples(char const* filename, AvroStructBinding<Sample> const& binding, int n)
+{
+    AvroStructReader<Sample> reader(filename, binding);
+    Sample s;
+    size_t capacity = 0;
+    int i = 0;
+    while (reader.read(s)) {
+        check_sample(s, i);
+        // Shorter arrays keep the storage of longer ones.
+        assert(s.coef.capacity() >= capacity);
+        capacity = s.coef.capacity();
+        i++;
+    }
+    assert(i == n);
+}
+
+
+// Decode records into a struct, skipping the fields that are not bound.
+void test_struct_reader()
+{
+    char const* filename = "/tmp/zpz_test_avro_writer_struct.avro";
+    auto schema = avro::compileJsonSchemaFromString(R"({
+        "type": "record",
+        "name": "sample",
+        "fields": [
+            {"name": "name", "type": "string"},
+            {"name": "coef", "type": {"type": "array", "items": "double"}},
+            {"name": "label", "type": ["null", "string"]},
+            {"name": "intercept", "type": "double"},
+            {"name": "attrs", "type": {"type": "map", "values": "long"}},
+            {"name": "points", "type": {"type": "array", "items": {
+                "type": "record", "name": "point",
+                "fields": [
+                    {"name": "x", "type": "double"},
+                    {"name": "tag", "type": ["null", "string"]}
+                ]}}},
+            {"name": "n", "type": "int"},
+            {"name": "flags", "type": {"type": "array", "items": "boolean"}}
+        ]
+    })");
+    auto binding = AvroStructBinding<Sample>()
+                   .field("coef", &Sample::coef)
+                   .field("intercept", &Sample::intercept)
+                   .field("n", &Sample::n)
+                   .field("flags", &Sample::flags);
+    int const n = 40;
+
+    // `AvroWriter` sets the bound fields, the string, and the union;
+    // the map and the array of records stay empty.
+    {
+        AvroWriter writer(filename, schema);
+        for (int i = 0; i < n; i++) {
+            Sample s;
+            for (int j = 0; j < i * 7 % 11; j++) {
+                s.coef.push_back(i + j * 0.5);
+            }
+            for (int j = 0; j < i % 4; j++) {
+                s.flags.push_back((i + j) % 2 == 0);
+            }
+            writer.set_scalar(std::string(i % 9, 'a' + i % 26), "name");
+            writer.set_vector(s.coef, "coef");
+            writer.set_scalar(std::string(i % 5, 'z'), "label");
+            writer.set_scalar(i * 2.0, "intercept");
+            writer.set_scalar(-i, "n");
+            writer.set_vector(s.flags, "flags");
+            writer.write();
+        }
+    }
+    read_samples(filename, binding, n);
+
+    // The same bound fields, with entries in the map and in the array of records.
+    {
+        avro::DataFileWriter<avro::GenericDatum> writer(filename, schema, 1024);
+        for (int i = 0; i < n; i++) {
+            avro::GenericDatum datum(schema);
+            auto& rec = datum.value<avro::GenericRecord>();
+            rec.fieldAt(0).value<std::string>() = std::to_string(i);
+            auto& coef = rec.fieldAt(1).value<avro::GenericArray>();
+            for (int j = 0; j < i * 7 % 11; j++) {
+                coef.value().push_back(avro::GenericDatum(coef.schema()->leafAt(0)));
+                coef.value().back().value<double>() = i + j * 0.5;
+            }
+            if (i % 3 == 0) {
+                rec.fieldAt(2).selectBranch(1);
+                rec.fieldAt(2).value<std::string>() = "label";
+            }
+            rec.fieldAt(3).value<double>() = i * 2.0;
+            auto& attrs = rec.fieldAt(4).value<avro::GenericMap>();
+            for (int j = 0; j < i % 6; j++) {
+                avro::GenericDatum value(attrs.schema()->leafAt(1));
+                value.value<long>() = long(i) << (j * 8);
+                attrs.value().emplace_back("key" + std::to_string(j), value);
+            }
+            auto& points = rec.fieldAt(5).value<avro::GenericArray>();
+            for (int j = 0; j < i % 5; j++) {
+                avro::GenericDatum point(points.schema()->leafAt(0));
+                auto& p = point.value<avro::GenericRecord>();
+                p.fieldAt(0).value<double>() = j;
+                if (j % 2 == 1) {
+                    p.fieldAt(1).selectBranch(1);
+                    p.fieldAt(1).value<std::string>() = std::string(j, 't');
+                }
+                points.value().push_back(point);
+            }
+            rec.fieldAt(6).value<int>() = -i;
+            auto& flags = rec.fieldAt(7).value<avro::GenericArray>();
+            for (int j = 0; j < i % 4; j++) {
+                flags.value().push_back(avro::GenericDatum(flags.schema()->leafAt(0)));
+                flags.value().back().value<bool>() = ((i + j) % 2 == 0);
+            }
+            writer.write(datum);
+        }
+    }
+    read_samples(filename, binding, n);
+
+    auto fails = [&](AvroStructBinding<Sample> const& b) {
+        try {
+            AvroStructReader<Sample> reader(filename, b);
+        } catch (AvroError const& e) {
+            std::cout << e.what() << std::endl;
+            return true;
+        }
+        return false;
+    };
+    [[maybe_unused]] bool failed = fails(AvroStructBinding<Sample>().field("name", &Sample::intercept));
+    assert(failed);
+    failed = fails(AvroStructBinding<Sample>().field("intercept", &Sample::coef));
+    assert(failed);
+    failed = fails(AvroStructBinding<Sample>().field("no_such_field", &Sample::n));
+    assert(failed);
+
+    std::remove(filename);
+}
+
+
+// Keep a field whose type is a named record defined in a field that is dropped.
+void test_prune_named_type()
+{
+    char const* filename = "/tmp/zpz_test_avro_writer_prune.avro";
+    std::string schema = R"({
+        "type": "record",
+        "name": "segment",
+        "fields": [
+            {"name": "start", "type": {
+                "type": "record", "name": "point",
+                "fields": [{"name": "x", "type": "double"}, {"name": "y", "type": "double"}]}},
+            {"name": "label", "type": {"type": "enum", "name": "kind", "symbols": ["a", "b"]}},
+            {"name": "end", "type": "point"},
+            {"name": "kinds", "type": {"type": "array", "items": "kind"}}
+        ]
+    })";
+    {
+        AvroWriter writer(filename, schema);
+        writer.set_scalar(1.0, "start", "x");
+        writer.set_scalar(2.0, "end", "x");
+        writer.set_scalar(3.0, "end", "y");
+        writer.write();
+    }
+
+    AvroReader reader(filename, {{"end"}, {"kinds"}});
+    assert(reader.get_record_size() == 2);
+    assert(reader.get_scalar<double>("end", "x") == 2.0);
+    assert(reader.get_scalar<double>("end", "y") == 3.0);
+
+    AvroReader partial(filename, {{"end", "y"}});
+    assert(partial.get_scalar<double>("end", "y") == 3.0);
+
+    // A pruned record keeps its name, hence it can not be used elsewhere as well.
+    for (auto keep : std::vector<std::vector<std::vector<std::string>>> {
+             {{"start", "x"}, {"end"}},
+             {{"start"}, {"end", "y"}},
+             {{"start", "x"}, {"end", "y"}}
+         }) {
+        bool thrown = false;
+        try {
+            AvroReader r(filename, keep);
+        } catch (AvroError const& e) {
+            thrown = true;
+            std::cout << e.what() << std::endl;
+        }
+        assert(thrown);
+    }
+
+    std::remove(filename);
+}
+
+
+// Compare the columns of an array of records with its rows.
+void test_columns()
+{
+    char const* filename = "/tmp/zpz_test_avro_writer_columns.avro";
+    auto schema = avro::compileJsonSchemaFromString(R"({
+        "type": "record",
+        "name": "shape",
+        "fields": [
+            {"name": "points", "type": {"type": "array", "items": {
+                "type": "record", "name": "point",
+                "fields": [
+                    {"name": "x", "type": "double"},
+                    {"name": "n", "type": "int"},
+                    {"name": "tag", "type": ["null", "string"]},
+                    {"name": "name", "type": "string"},
+                    {"name": "flag", "type": "boolean"}
+                ]}}}
+        ]
+    })");
+    int const n = 50;
+    {
+        avro::DataFileWriter<avro::GenericDatum> writer(filename, schema);
+        avro::GenericDatum datum(schema);
+        auto& points = datum.value<avro::GenericRecord>().fieldAt(0).value<avro::GenericArray>();
+        for (int i = 0; i < n; i++) {
+            avro::GenericDatum point(points.schema()->leafAt(0));
+            auto& rec = point.value<avro::GenericRecord>();
+            rec.fieldAt(0).value<double>() = i * 0.5;
+            rec.fieldAt(1).value<int>() = i;
+            rec.fieldAt(3).value<std::string>() = std::string(i % 7, 'a' + i % 26);
+            rec.fieldAt(4).value<bool>() = (i % 3 == 0);
+            points.value().push_back(point);
+        }
+        writer.write(datum);
+    }
+
+    AvroReader reader(filename);
+    auto columns = reader.get_columns("points");
+    assert(columns.size() == n);
+    assert(columns.size() == reader.get_array_size("points"));
+    assert((columns.names() == std::vector<std::string>{"x", "n", "name", "flag"}));
+    assert(!columns.has_column("tag"));
+
+    auto const& x = columns.get<double>("x");
+    auto const& ns = columns.get<int>("n");
+    auto const& flags = columns.get<bool>("flag");
+    auto const& names = columns.get_strings("name");
+    assert(names.size() == n);
+    assert(names.offsets().back() == names.chars().size());
+    for (int i = 0; i < n; i++) {
+        reader.save_cursor();
+        reader.seek_in_array(i, "points");
+        assert(x[i] == reader.get_scalar<double>("x"));
+        assert(ns[i] == reader.get_scalar<int>("n"));
+        assert(flags[i] == reader.get_scalar<bool>("flag"));
+        assert(names[i] == reader.get_scalar<std::string>("name"));
+        reader.restore_cursor();
+    }
+
+    bool thrown = false;
+    try {
+        columns.get<int>("x");
+    } catch (AvroError const& e) {
+        thrown = true;
+    }
+    assert(thrown);
+    thrown = false;
+    try {
+        columns.get_strings("x");
+    } catch (AvroError const& e) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    std::remove(filename);
+}
+
+
+int main()
+{
+    char const* filename = "/tmp/zpz_test_avro_writer.avro";
+    std::string schema = R"({
+        "type": "record",
+        "name": "model",
+        "fields": [
+            {"name": "coef", "type": {"type": "array", "items": "double"}},
+            {"name": "intercept", "type": "double"},
+            {"name": "label", "type": ["null", "string"]}
+        ]
+    })";
+
+    int const n = 1000;
+    {
+        AvroWriter writer(filename, schema, 4096, avro::DEFLATE_CODEC);
+        auto coef = writer.make_path("coef");
+        std::vector<double> values(100);
+        for (int i = 0; i < n; i++) {
+            for (size_t j = 0; j < values.size(); j++) {
+                values[j] = i + j * 0.5;
+            }
+            writer.set_vector(values, coef);
+            writer.set_scalar(double(i), "intercept");
+            if (i % 2 == 0) {
+                writer.set_scalar(std::string("even"), "label");
+            }
+            writer.write();
+        }
+    }
+
+    auto reader = AvroReader(filename);
+    auto coef = reader.make_path("coef");
+    int i = 0;
+    for (auto& record : reader.records()) {
+        auto values = record.get_vector<double>(coef);
+        assert(values.size() == 100);
+        assert(values[3] == i + 1.5);
+
+        auto view = record.get_array_view<double>(coef);
+        assert(view.size() == 100);
+        assert(view[3] == i + 1.5);
+        assert(std::equal(view.begin(), view.end(), values.begin()));
+        assert(view.end() - view.begin() == 100);
+
+        double buffer[100];
+        assert(record.copy_vector(buffer, 100, coef) == 100);
+        assert(std::equal(buffer, buffer + 100, values.begin()));
+        bool thrown = false;
+        try {
+            record.copy_vector(buffer, 99, coef);
+        } catch (AvroError const& e) {
+            thrown = true;
+        }
+        assert(thrown);
+        assert(record.get_scalar<double>("intercept") == i);
+        if (i == 0) {
+            assert(record.get_scalar<std::string>("label") == "even");
+        }
+        i++;
+    }
+    std::cout << "records read back: " << i << std::endl;
+    assert(i == n);
+
+    auto stats = avro_file_stats(filename);
+    std::cout << "blocks: " << stats.n_blocks << ", records: " << stats.n_records
+              << ", codec: " << stats.codec << std::endl;
+    assert(stats.n_records == n);
+    assert(stats.n_blocks > 1);
+    assert(stats.codec == "deflate");
+
+    test_parallel(filename, n);
+    test_struct_reader();
+    test_prune_named_type();
+    test_columns();
+
+    std::remove(filename);
+}
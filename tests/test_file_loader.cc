@@ -0,0 +1,140 @@
+#include "zpz/file_loader.h"
+
+#include <sys/stat.h>
+
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace zpz;
+
+
+std::vector<std::string> make_files(std::vector<std::string>& contents)
+{
+    // Sizes around the 4 MiB chunks of the ring, and an empty file.
+    std::vector<size_t> sizes{0, 1, 100, 4096, 4 * 1024 * 1024, 9 * 1024 * 1024 + 7};
+    for (int i = 0; i < 50; i++) {
+        sizes.push_back(std::rand() % 100000);
+    }
+    std::vector<std::string> filenames;
+    for (size_t i = 0; i < sizes.size(); i++) {
+        std::string content(sizes[i], ' ');
+        for (auto& c : content) {
+            c = 'a' + std::rand() % 26;
+        }
+        auto filename = "/tmp/zpz_test_file_loader_" + std::to_string(i);
+        std::ofstream f(filename, std::ios::binary);
+        f << content;
+        filenames.push_back(filename);
+        contents.push_back(content);
+    }
+    return filenames;
+}
+
+
+void test_load(bool use_io_uring, std::vector<std::string> const& filenames,
+               std::vector<std::string> const& contents)
+{
+    FileLoader loader(4, use_io_uring);
+    std::cout << "io_uring: " << loader.uses_io_uring() << std::endl;
+    if (use_io_uring && !loader.uses_io_uring()) {
+        // As in many containers and CI runners; then the ring is not tested.
+        std::cout << "io_uring is not available; the test of the ring is skipped" << std::endl;
+        return;
+    }
+
+    auto futures = loader.load_all(filenames);
+    auto missing = loader.load("/tmp/zpz_no_such_file");
+    auto proc = loader.load("/proc/self/status");
+    for (size_t i = 0; i < futures.size(); i++) {
+        assert(futures[i].get() == contents[i]);
+    }
+    bool thrown = false;
+    try {
+        missing.get();
+    } catch (Error const& e) {
+        thrown = true;
+        std::cout << e.what() << std::endl;
+    }
+    assert(thrown);
+    assert(proc.get().find("Name:") == 0);
+
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t n_done = 0;
+    size_t n_bytes = 0;
+    for (auto const& f : filenames) {
+        loader.load(f, [&](std::string&& content, std::exception_ptr error) {
+            assert(!error);
+            // Notify under the lock, as the waiter destroys `done` once it sees the count.
+            std::lock_guard<std::mutex> lock(mutex);
+            n_bytes += content.size();
+            n_done++;
+            done.notify_one();
+        });
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&] {
+            return n_done == filenames.size();
+        });
+    }
+    size_t total = 0;
+    for (auto const& c : contents) {
+        total += c.size();
+    }
+    assert(n_bytes == total);
+}
+
+
+// A FIFO without a writer blocks whoever opens it; other files must not wait for it.
+void test_fifo(bool use_io_uring, std::string const& other, std::string const& other_content)
+{
+    std::string fifo = "/tmp/zpz_test_file_loader_fifo";
+    std::remove(fifo.c_str());
+    [[maybe_unused]] int made = ::mkfifo(fifo.c_str(), 0600);
+    assert(made == 0);
+
+    FileLoader loader(2, use_io_uring);
+    if (use_io_uring && !loader.uses_io_uring()) {
+        std::remove(fifo.c_str());
+        return;
+    }
+    auto blocked = loader.load(fifo);
+    auto f = loader.load(other);
+    assert(f.wait_for(std::chrono::seconds(10)) == std::future_status::ready);
+    assert(f.get() == other_content);
+
+    {
+        std::ofstream out(fifo);
+        out << "through the fifo";
+    }
+    assert(blocked.get() == "through the fifo");
+    std::remove(fifo.c_str());
+}
+
+
+int main()
+{
+    std::srand(11);
+    std::vector<std::string> contents;
+    auto filenames = make_files(contents);
+
+    test_load(true, filenames, contents);
+    test_load(false, filenames, contents);
+    assert(read_files(filenames) == contents);
+    test_fifo(true, filenames[2], contents[2]);
+    test_fifo(false, filenames[2], contents[2]);
+
+    for (auto const& f : filenames) {
+        std::remove(f.c_str());
+    }
+}
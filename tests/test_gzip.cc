@@ -0,0 +1,189 @@
+#include "zpz/gzip.h"
+#include "zpz/io.h"
+#include "zpz/line_reader.h"
+
+#include <sys/resource.h>
+#include <zlib.h>
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace zpz;
+
+
+void write_gzip(std::string const& filename, std::string const& text)
+{
+    gzFile f = gzopen(filename.c_str(), "wb");
+    assert(f);
+    if (!text.empty()) {
+        [[maybe_unused]] int n = gzwrite(f, text.data(), text.size());
+        assert(n == static_cast<int>(text.size()));
+    }
+    gzclose(f);
+}
+
+
+std::string random_text(size_t n_lines)
+{
+    std::string text;
+    for (size_t i = 0; i < n_lines; i++) {
+        text += "line " + std::to_string(i) + "\t" + std::to_string(std::rand()) + "\n";
+    }
+    return text;
+}
+
+
+std::string drain(GzipReader& in)
+{
+    std::string z;
+    std::string_view chunk;
+    while (in.next(chunk)) {
+        z.append(chunk);
+    }
+    return z;
+}
+
+
+void test_reader(std::string const& filename, std::string const& text)
+{
+    for (bool threaded : {false, true}) {
+        GzipReader in(filename, threaded, 5000);
+        assert(in.size_hint() == text.size());
+        assert(drain(in) == text);
+
+        GzipReader in2(filename, threaded);
+        std::string z;
+        char buf[777];
+        while (size_t n = in2.read(buf, sizeof(buf))) {
+            z.append(buf, n);
+        }
+        assert(z == text);
+    }
+    std::cout << "reader: OK" << std::endl;
+}
+
+
+void test_io(std::string const& filename, std::string const& text)
+{
+    assert(read_text_or_gzip_file(filename) == text);
+    assert(read_gzip_file(filename) == text);
+    assert(is_gzip(read_binary_file(filename)));
+
+    // Concatenated streams read as one.
+    std::string both = read_binary_file(filename) + read_binary_file(filename);
+    {
+        FILE* f = std::fopen("/tmp/zpz_test_gzip_2.gz", "wb");
+        std::fwrite(both.data(), 1, both.size(), f);
+        std::fclose(f);
+    }
+    assert(read_text_or_gzip_file("/tmp/zpz_test_gzip_2.gz") == text + text);
+
+    // Truncated.
+    {
+        FILE* f = std::fopen("/tmp/zpz_test_gzip_2.gz", "wb");
+        std::fwrite(both.data(), 1, both.size() / 3, f);
+        std::fclose(f);
+    }
+    for (bool threaded : {false, true}) {
+        bool thrown = false;
+        try {
+            GzipReader in("/tmp/zpz_test_gzip_2.gz", threaded);
+            drain(in);
+        } catch (Error const& e) {
+            thrown = true;
+            std::cout << e.what() << std::endl;
+        }
+        assert(thrown);
+    }
+    std::remove("/tmp/zpz_test_gzip_2.gz");
+
+    write_gzip("/tmp/zpz_test_gzip_2.gz", "");
+    assert(read_text_or_gzip_file("/tmp/zpz_test_gzip_2.gz").empty());
+    std::remove("/tmp/zpz_test_gzip_2.gz");
+
+    // Files that are not compressed are read as they are.
+    assert(read_text_or_gzip_file("/proc/self/status").find("Name:") == 0);
+    std::cout << "io: OK" << std::endl;
+}
+
+
+void test_lines(std::string const& filename, std::string const& text)
+{
+    LineReader reader(filename, 4096);
+    std::string_view line;
+    std::string z;
+    while (reader.next(line)) {
+        z.append(line);
+        z.push_back('\n');
+    }
+    assert(z == text);
+    std::cout << "lines: OK" << std::endl;
+}
+
+
+void test_stream(std::string const& filename, std::string const& text)
+{
+    GzipReader in(filename, true, 4096);
+    GzipStream stream(in);
+    std::string z;
+    while (stream.Peek() != '\0') {
+        z.push_back(stream.Take());
+    }
+    assert(z == text);
+    assert(stream.Tell() == text.size());
+    std::cout << "stream: OK" << std::endl;
+}
+
+
+// A gzip trailer that claims 4 GiB must not make `read_gzip` allocate that much
+// up front; it only fails the check of the length at the end.
+void test_size_hint(std::string const& filename)
+{
+    std::string data = read_binary_file(filename);
+    data.replace(data.size() - 4, 4, "\xff\xff\xff\xff");
+    {
+        FILE* f = std::fopen("/tmp/zpz_test_gzip_2.gz", "wb");
+        std::fwrite(data.data(), 1, data.size(), f);
+        std::fclose(f);
+    }
+    assert(GzipReader("/tmp/zpz_test_gzip_2.gz").size_hint() == 0xffffffffu);
+
+    // Far less address space than the claimed size.
+    rlimit old;
+    ::getrlimit(RLIMIT_AS, &old);
+    rlimit limit = old;
+    limit.rlim_cur = 2ul << 30;
+    ::setrlimit(RLIMIT_AS, &limit);
+    bool thrown = false;
+    try {
+        read_gzip_file("/tmp/zpz_test_gzip_2.gz");
+    } catch (Error const& e) {
+        thrown = true;
+        std::cout << e.what() << std::endl;
+    }
+    ::setrlimit(RLIMIT_AS, &old);
+    assert(thrown);
+    std::remove("/tmp/zpz_test_gzip_2.gz");
+    std::cout << "size hint: OK" << std::endl;
+}
+
+
+int main()
+{
+    std::srand(13);
+    std::string filename = "/tmp/zpz_test_gzip.txt.gz";
+    auto text = random_text(300000);
+    write_gzip(filename, text);
+
+    test_reader(filename, text);
+    test_io(filename, text);
+    test_lines(filename, text);
+    test_stream(filename, text);
+    test_size_hint(filename);
+    std::remove(filename.c_str());
+}
@@ -0,0 +1,516 @@
+#include "zpz/json.h"
+
+#include <zlib.h>
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+using namespace zpz;
+
+
+// Count the calls of `malloc` and `realloc`, including those of `new`, and the bytes
+// they request, to check that a reader reuses its memory.
+extern "C" void* __libc_malloc(size_t);
+extern "C" void* __libc_realloc(void*, size_t);
+
+std::atomic<size_t> n_allocs{0};
+std::atomic<size_t> n_alloc_bytes{0};
+
+extern "C" void* malloc(size_t size)
+{
+    n_allocs++;
+    n_alloc_bytes += size;
+    return __libc_malloc(size);
+}
+
+extern "C" void* realloc(void* p, size_t size)
+{
+    n_allocs++;
+    n_alloc_bytes += size;
+    return __libc_realloc(p, size);
+}
+
+
+template <typename F>
+bool throws(F f)
+{
+    try {
+        f();
+    } catch (Error const& e) {
+        return true;
+    }
+    return false;
+}
+
+
+std::string const doc = R"({
+    "name": "a \"quoted\" \u00e9 name", "id": 12345678901, "score": -0.25, "ok": false, "none": null,
+    "tags": ["x", "y", "z"], "matrix": [[1.5, 2.5], [3.5, 4.5]],
+    "nested": {"a": {"b": {"c": [1, {"d": "deep"}]}}, "e": [], "f": {}},
+    "records": [{"k": 1, "v": "one"}, {"k": 2, "v": "two"}]
+})";
+
+
+// What `reader` finds at many places in `doc`, as a string, to compare readers.
+std::string probe(JsonReader& reader)
+{
+    std::ostringstream out;
+    out << reader.get_scalar<std::string>("name") << '|'
+        << reader.get_scalar<long>("id") << '|'
+        << reader.get_scalar<double>("score") << '|'
+        << reader.get_scalar<bool>("ok") << '|'
+        << reader.is_null("none") << '|';
+    for (auto const& tag : reader.get_vector<std::string>("tags")) {
+        out << tag << ',';
+    }
+    for (auto x : reader.get_vector<double>("matrix", 1)) {
+        out << x << ',';
+    }
+    out << reader.get_scalar<std::string>("nested", "a", "b", "c", 1, "d") << '|'
+        << reader.get_array_size("nested", "e") << '|'
+        << reader.is_object("nested", "f") << '|'
+        << reader.has_member("nested", "x") << '|'
+        << reader.is_string_array("tags") << reader.is_int_array("tags") << '|';
+
+    reader.save_cursor();
+    reader.seek("records", 1);
+    out << reader.get_scalar<int>("k") << reader.get_scalar<std::string>("v") << '|'
+        << reader.is_bool("/", "ok") << '|';
+    reader.restore_cursor();
+    return out.str();
+}
+
+
+// Scalars of every type that `get_vector` supports, read by `get_scalar` as well.
+void test_scalars()
+{
+    JsonReader reader(std::string(R"({"u": 4000000000, "i": -3, "f": 0.5, "s": "a\u0000b", "v": [4000000000]})"));
+    assert(reader.get_scalar<unsigned>("u") == 4000000000u);
+    assert(reader.get_vector<unsigned>("v")[0] == 4000000000u);
+    assert(reader.get_scalar<long>("u") == 4000000000);
+    assert(reader.get_scalar<int>("i") == -3);
+    assert(reader.get_scalar<float>("f") == 0.5f);
+    // An embedded NUL does not cut the string short.
+    assert(reader.get_scalar<std::string>("s") == std::string("a\0b", 3));
+    assert(throws([&] { reader.get_scalar<unsigned>("i"); }));
+    assert(throws([&] { reader.get_scalar<int>("u"); }));
+    assert(throws([&] { reader.get_scalar<std::string>("f"); }));
+}
+
+
+void test_arena()
+{
+    JsonReader reader(JsonReader::ArenaOptions{64 * 1024, 64 * 1024, 4096});
+    std::string small = R"({"name": "a string long enough to grow the stack of the parser beyond its first block",
+                            "values": [1, 2, 3, {"x": [4.5, "y", null]}], "ok": true})";
+    std::string large = "[";
+    for (int i = 0; i < 10000; i++) {
+        large += (i ? ", " : "") + std::string(R"({"i": )") + std::to_string(i) + "}";
+    }
+    large += "]";
+
+    reader.reset(small);
+    size_t before = n_allocs;
+    for (int i = 0; i < 100; i++) {
+        reader.reset(small);
+        assert(reader.get_scalar<bool>("ok"));
+        assert(reader.get_scalar<double>("values", 3, "x", 0) == 4.5);
+    }
+    std::cout << "allocations in 100 resets: " << n_allocs - before << std::endl;
+    assert(n_allocs == before);
+
+    // A document larger than the arena takes more chunks, which are released
+    // by the next reset.
+    reader.reset(large);
+    assert(reader.get_array_size() == 10000);
+    assert(reader.get_scalar<int>(9999, "i") == 9999);
+    reader.reset(small);
+    before = n_allocs;
+    for (int i = 0; i < 100; i++) {
+        reader.reset(small);
+    }
+    assert(n_allocs == before);
+}
+
+
+void test_lines()
+{
+    char const* filename = "/tmp/zpz_test_json_lines.json";
+    int const n = 20000;
+    long expected = 0;
+    {
+        std::ofstream out(filename);
+        for (int i = 0; i < n; i++) {
+            out << R"({"id": )" << i << R"(, "text": ")" << std::string(i % 100, 'x') << "\"}\n";
+            expected += i;
+            if (i % 1000 == 0) {
+                out << " \t\r\n";
+            }
+        }
+        // A line longer than a chunk.
+        out << R"({"id": )" << n << R"(, "text": ")" << std::string(10000, 'y') << "\"}";
+        expected += n;
+    }
+
+    JsonLinesReader reader(filename, 4, 4096);
+    std::atomic<long> total{0};
+    std::atomic<int> count{0};
+    reader.for_each([&](JsonReader& record) {
+        total += record.get_scalar<long>("id");
+        count++;
+    });
+    assert(count == n + 1);
+    assert(total == expected);
+
+    {
+        std::ofstream out(filename, std::ios::app);
+        out << "\n{\"id\": \n";
+    }
+    bool thrown = false;
+    try {
+        reader.for_each([&](JsonReader&) {});
+    } catch (Error const& e) {
+        thrown = true;
+        std::cout << e.what() << std::endl;
+    }
+    assert(thrown);
+
+    // The file is gone by the time it is read.
+    std::remove(filename);
+    assert(throws([&] { reader.for_each([&](JsonReader&) {}); }));
+}
+
+
+// Look up members through the index, lazily built on multiple threads or eagerly,
+// and compare with rapidjson's lookup.
+void test_member_index()
+{
+    std::string json = "{";
+    for (int i = 0; i < 200; i++) {
+        json += "\"k" + std::to_string(i) + "\": {\"v\": " + std::to_string(i) + "}, ";
+    }
+    json += R"("k7": {"v": -1}, "small": {"a": 1, "b": 2}})";
+
+    JsonReader plain(json);
+    for (bool eager : {false, true}) {
+        JsonReader reader(json);
+        reader.index_members(8, eager);
+        JsonReader const& shared = reader;
+        std::vector<std::thread> threads;
+        std::atomic<int> n_checked{0};
+        for (int t = 0; t < 4; t++) {
+            threads.emplace_back([&, t] {
+                for (int i = t; i < 200; i += 4) {
+                    auto name = "k" + std::to_string(i);
+                    if (shared.get_scalar<int>(name, "v") == plain.get_scalar<int>(name, "v")) {
+                        n_checked++;
+                    }
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        assert(n_checked == 200);
+        // The first of duplicate members wins, as in rapidjson.
+        assert(reader.get_scalar<int>("k7", "v") == 7);
+        assert(reader.get_scalar<int>("small", "b") == 2);
+        assert(!reader.has_member("k200"));
+    }
+}
+
+
+void test_copy()
+{
+    JsonReader reader(R"({"v": [0.5, 1.5, 2.5], "ids": [1, 2, 3], "m": [[1.5, 2.5], [3.5, 4.5], [5.5, 6.5]],
+                         "ragged": [[1.5], [2.5, 3.5]], "mixed": [0.5, "x"], "empty": []})");
+    double buffer[8];
+    assert(reader.copy_vector(buffer, 8, "v") == 3);
+    assert(std::vector<double>(buffer, buffer + 3) == reader.get_vector<double>("v"));
+    int ids[3];
+    assert(reader.copy_vector(ids, 3, "ids") == 3);
+    assert(std::vector<int>(ids, ids + 3) == reader.get_vector<int>("ids"));
+
+    auto shape = reader.copy_matrix(buffer, 8, "m");
+    assert(shape == std::make_pair(size_t(3), size_t(2)));
+    assert(std::vector<double>(buffer, buffer + 2) == reader.get_vector<double>("m", 0));
+    assert(std::vector<double>(buffer + 4, buffer + 6) == reader.get_vector<double>("m", 2));
+    assert(reader.copy_matrix(buffer, 8, "empty") == std::make_pair(size_t(0), size_t(0)));
+
+    assert(throws([&] { reader.copy_vector(buffer, 2, "v"); }));
+    assert(throws([&] { reader.copy_vector(buffer, 8, "mixed"); }));
+    assert(throws([&] { reader.copy_vector(ids, 3, "v"); }));
+    assert(throws([&] { reader.copy_matrix(buffer, 5, "m"); }));
+    assert(throws([&] { reader.copy_matrix(buffer, 8, "ragged"); }));
+    assert(throws([&] { reader.copy_matrix(buffer, 8, "v"); }));
+}
+
+
+// Read `doc` through each backend, visiting its parts in different orders.
+void test_backends()
+{
+    JsonReader expected(doc);
+    auto reference = probe(expected);
+    std::cout << reference << std::endl;
+
+    for (auto backend : {JsonReader::Backend::rapidjson, JsonReader::Backend::simd, JsonReader::Backend::lazy,
+                         JsonReader::Backend::parallel
+                        }) {
+        JsonReader reader(doc, backend);
+        assert(reader.backend() == backend);
+        // Step into the deepest part first, which a lazy reader has not parsed yet.
+        assert(reader.get_scalar<int>("nested", "a", "b", "c", 0) == 1);
+        assert(probe(reader) == reference);
+        // Again, once everything has been parsed.
+        assert(probe(reader) == reference);
+
+        reader.reset(R"({"other": [1, 2]})");
+        assert(reader.get_array_size("other") == 2);
+        reader.reset(doc);
+        assert(probe(reader) == reference);
+
+        assert(throws([&] { reader.get_scalar<int>("name"); }));
+        assert(throws([&] { reader.seek("records", 2); }));
+    }
+
+    // Nested values that a lazy reader does not visit are not validated.
+    JsonReader lazy(R"({"good": 1, "bad": [1, 2,, 3]})", JsonReader::Backend::lazy);
+    assert(lazy.get_scalar<int>("good") == 1);
+    assert(throws([&] { lazy.get_array_size("bad"); }));
+}
+
+
+void test_path_trie()
+{
+    JsonPathTrie trie;
+    trie.add({"a", "b"}, 0);
+    trie.add({"a", "c", 1}, 1);
+    trie.add({"a", "b"}, 2);
+    trie.add({"a", "/", "a"}, 3);
+    auto const& root = trie.root();
+    assert(root.slots.empty());
+    assert(root.members.size() == 1 && root.items.empty());
+    auto const& a = *root.members[0].second;
+    assert(a.members.size() == 2);
+    assert(a.members[0].first == "b");
+    assert((a.members[0].second->slots == std::vector<size_t>{0, 2}));
+    assert(a.members[1].second->items.size() == 1);
+    assert(a.members[1].second->items[0].first == 1);
+    assert(trie.document_root().members.size() == 1);
+    assert((trie.document_root().members[0].second->slots == std::vector<size_t>{3}));
+    assert(throws([&] { trie.add({"a", ""}, 4); }));
+}
+
+
+// Compare a query with the seeks of its paths one by one.
+void test_query()
+{
+    JsonQuery<std::string, long, std::vector<double>, std::string, int, bool, std::vector<std::string>> q{
+        {"name"},
+        {"id"},
+        {"matrix", 1},
+        {"nested", "a", "b", "c", 1, "d"},
+        {"records", 1, "k"},
+        {"/", "ok"},
+        {"tags"}};
+    JsonQuery<int, int, std::string> relative{
+        {"k"},
+        {"/", "records", 1, "k"},
+        {"v"}};
+    JsonQuery<int> missing{{"records", 0, "x"}};
+
+    for (auto backend : {JsonReader::Backend::rapidjson, JsonReader::Backend::lazy}) {
+        JsonReader reader(doc, backend);
+        auto [name, id, row, deep, k, ok, tags] = reader.query(q);
+        assert(name == reader.get_scalar<std::string>("name"));
+        assert(id == reader.get_scalar<long>("id"));
+        assert(row == reader.get_vector<double>("matrix", 1));
+        assert(deep == reader.get_scalar<std::string>("nested", "a", "b", "c", 1, "d"));
+        assert(k == reader.get_scalar<int>("records", 1, "k"));
+        assert(ok == reader.get_scalar<bool>("ok"));
+        assert(tags == reader.get_vector<std::string>("tags"));
+
+        reader.seek("records", 0);
+        auto [k0, k1, v0] = reader.query(relative);
+        assert(k0 == 1 && k1 == 2 && v0 == "one");
+        reader.seek("/");
+        // "/" is the root in `seek` as in a query.
+        assert(reader.get_scalar<int>("records", 0, "/", "records", 1, "k") == 2);
+
+        assert(throws([&] { reader.query(missing); }));
+        assert(throws([&] { reader.query(relative); }));
+    }
+}
+
+
+// The message of the error of parsing `json` with `backend`, or "" if it parses.
+std::string parse_error(JsonReader& reader, std::string const& json, JsonReader::Backend backend)
+{
+    reader.set_backend(backend);
+    try {
+        reader.reset(json);
+    } catch (Error const& e) {
+        return e.what();
+    }
+    return "";
+}
+
+
+// Parse a large array in parallel and compare with the serial parse.
+void test_parallel()
+{
+    int const n = 20000;
+    std::vector<std::string> elements;
+    for (int i = 0; i < n; i++) {
+        elements.push_back(R"({"i": )" + std::to_string(i) + R"(, "s": "a, b] \"c\" [", "v": [)"
+                           + std::to_string(i * 0.5) + R"(, {"w": [1, 2]}, null, true]})");
+    }
+    auto join = [&](std::vector<std::string> const& elems) {
+        std::string z = "[";
+        for (size_t i = 0; i < elems.size(); i++) {
+            z += (i ? ",\n " : "\n ") + elems[i];
+        }
+        return z + "\n]\n";
+    };
+    auto json = join(elements);
+    assert(json.size() > (1 << 20));
+
+    JsonReader serial(json);
+    JsonReader reader(JsonReader::ArenaOptions{});
+    reader.set_backend(JsonReader::Backend::parallel);
+    reader.set_threads(4);
+    for (int repeat = 0; repeat < 2; repeat++) {
+        reader.reset(json);
+        assert(reader.get_array_size() == n);
+        for (int i = 0; i < n; i++) {
+            assert(reader.get_scalar<int>(i, "i") == i);
+            assert(reader.get_scalar<std::string>(i, "s") == serial.get_scalar<std::string>(i, "s"));
+            assert(reader.get_scalar<double>(i, "v", 0) == serial.get_scalar<double>(i, "v", 0));
+            assert(reader.get_vector<int>(i, "v", 1, "w") == serial.get_vector<int>(i, "v", 1, "w"));
+            assert(reader.is_null(i, "v", 2));
+        }
+    }
+
+    // Memory grows with the document, as in a serial parse, not with the number of elements
+    // parsed one by one.
+    {
+        JsonReader one(JsonReader::ArenaOptions{});
+        size_t before = n_alloc_bytes;
+        one.reset(json);
+        size_t serial_bytes = n_alloc_bytes - before;
+        before = n_alloc_bytes;
+        reader.reset(json);
+        size_t parallel_bytes = n_alloc_bytes - before;
+        std::cout << "bytes allocated by a serial parse: " << serial_bytes
+                  << ", by a parallel parse: " << parallel_bytes << std::endl;
+        assert(parallel_bytes < serial_bytes * 3 / 2);
+    }
+
+    // Errors in the first, a middle and the last element, reported at the same offsets.
+    JsonReader checker(JsonReader::ArenaOptions{});
+    checker.set_threads(4);
+    for (int i : {0, n / 3, n / 2 + 1, n - 1}) {
+        std::vector<std::vector<std::string>> variants(4, elements);
+        variants[0][i] = "tru";
+        variants[1][i] = " ";
+        variants[2][i] = "1 2";
+        variants[3][i] = R"({"i": 1,})";
+        for (auto const& v : variants) {
+            auto text = join(v);
+            auto expected = parse_error(checker, text, JsonReader::Backend::rapidjson);
+            assert(!expected.empty());
+            assert(parse_error(checker, text, JsonReader::Backend::parallel) == expected);
+        }
+    }
+    std::cout << parse_error(checker, join(std::vector<std::string>(n, "[1,]")), JsonReader::Backend::parallel)
+              << std::endl;
+
+    // Other documents are parsed serially.
+    std::string object = R"({"a": )" + json + "}";
+    assert(parse_error(checker, object, JsonReader::Backend::parallel) == "");
+    assert(checker.get_array_size("a") == n);
+}
+
+
+void write_file(std::string const& filename, std::string const& text, bool compress)
+{
+    if (compress) {
+        gzFile f = gzopen(filename.c_str(), "wb");
+        assert(f);
+        [[maybe_unused]] int n = gzwrite(f, text.data(), text.size());
+        assert(n == static_cast<int>(text.size()));
+        gzclose(f);
+    } else {
+        std::ofstream out(filename, std::ios::binary);
+        out << text;
+    }
+}
+
+
+// A .json.gz file reads the same as the plain file.
+void test_gzip()
+{
+    std::string plain = "/tmp/zpz_test_json.json";
+    std::string compressed = "/tmp/zpz_test_json.json.gz";
+    write_file(plain, doc, false);
+    write_file(compressed, doc, true);
+
+    JsonReader expected(plain.c_str());
+    auto reference = probe(expected);
+    JsonReader reader(compressed.c_str());
+    assert(probe(reader) == reference);
+    for (auto backend : {JsonReader::Backend::rapidjson, JsonReader::Backend::lazy}) {
+        JsonReader r(compressed.c_str(), backend);
+        assert(probe(r) == reference);
+    }
+
+    // Larger than the chunks of decompression.
+    std::string large = "[" + doc;
+    for (int i = 1; i < 5000; i++) {
+        large += ", " + doc;
+    }
+    large += "]";
+    write_file(plain, large, false);
+    write_file(compressed, large, true);
+    JsonReader a(plain.c_str());
+    JsonReader b(compressed.c_str());
+    assert(b.get_array_size() == 5000);
+    assert(b.get_scalar<std::string>(4999, "nested", "a", "b", "c", 1, "d")
+           == a.get_scalar<std::string>(4999, "nested", "a", "b", "c", 1, "d"));
+
+    // Truncated.
+    std::string data = read_binary_file(compressed);
+    {
+        std::ofstream out(compressed, std::ios::binary);
+        out << data.substr(0, data.size() / 2);
+    }
+    assert(throws([&] { JsonReader r(compressed.c_str()); }));
+
+    std::remove(plain.c_str());
+    std::remove(compressed.c_str());
+}
+
+
+int main()
+{
+    test_scalars();
+    test_arena();
+    test_lines();
+    test_member_index();
+    test_copy();
+    test_backends();
+    test_path_trie();
+    test_query();
+    test_parallel();
+    test_gzip();
+}
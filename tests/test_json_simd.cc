@@ -0,0 +1,279 @@
+#include "zpz/json_simd.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace zpz;
+
+using Level = JsonStructuralIndex::Level;
+
+
+// Writes the events in a compact notation to compare against.
+struct EventWriter {
+    std::ostringstream out;
+
+    bool Null() { out << "null "; return true; }
+    bool Bool(bool b) { out << (b ? "true " : "false "); return true; }
+    bool Int(int i) { out << "i" << i << " "; return true; }
+    bool Uint(unsigned u) { out << "u" << u << " "; return true; }
+    bool Int64(int64_t i) { out << "I" << i << " "; return true; }
+    bool Uint64(uint64_t u) { out << "U" << u << " "; return true; }
+    bool Double(double d) { out << "d" << d << " "; return true; }
+    bool String(char const* s, unsigned len, bool) { out << "s'" << std::string(s, len) << "' "; return true; }
+    bool StartObject() { out << "{ "; return true; }
+    bool Key(char const* s, unsigned len, bool) { out << "k'" << std::string(s, len) << "' "; return true; }
+    bool EndObject(unsigned n) { out << "}" << n << " "; return true; }
+    bool StartArray() { out << "[ "; return true; }
+    bool EndArray(unsigned n) { out << "]" << n << " "; return true; }
+    bool Skipped(size_t begin, size_t end) { out << "~" << begin << "-" << end << " "; return true; }
+};
+
+
+std::vector<Level> levels()
+{
+    std::vector<Level> z{Level::scalar};
+    auto best = JsonStructuralIndex::best_level();
+    if (best >= Level::sse2) {
+        z.push_back(Level::sse2);
+    }
+    if (best >= Level::avx2) {
+        z.push_back(Level::avx2);
+    }
+    return z;
+}
+
+
+std::string events(std::string const& json, Level level)
+{
+    JsonSimdParser parser(level);
+    EventWriter w;
+    parser.parse(json.data(), json.size(), w);
+    return w.out.str();
+}
+
+
+bool fails(std::string const& json, Level level)
+{
+    try {
+        events(json, level);
+    } catch (Error const& e) {
+        return true;
+    }
+    return false;
+}
+
+
+// Structural positions by a byte-at-a-time scan.
+// A quote right after a scalar, as in `1"a"`, is invalid JSON; it is taken as
+// a part of the scalar, so that the number fails to parse.
+std::vector<uint32_t> naive_structurals(std::string const& json)
+{
+    std::vector<uint32_t> z;
+    bool in_string = false;
+    bool prev_scalar = false;
+    for (size_t i = 0; i < json.size(); i++) {
+        char c = json[i];
+        if (in_string) {
+            if (c == '\\') {
+                i++;
+            } else if (c == '"') {
+                in_string = false;
+            }
+            prev_scalar = false;
+            continue;
+        }
+        if (c == '"') {
+            if (!prev_scalar) {
+                z.push_back(i);
+            }
+            in_string = true;
+            prev_scalar = false;
+        } else if (c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',') {
+            z.push_back(i);
+            prev_scalar = false;
+        } else if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            prev_scalar = false;
+        } else {
+            if (!prev_scalar) {
+                z.push_back(i);
+            }
+            prev_scalar = true;
+        }
+    }
+    return z;
+}
+
+
+void test_structurals()
+{
+    std::srand(7);
+    char const outside[] = "{}[]:, \nab1";
+    char const inside[] = "{}[]:, ab1";
+    for (int round = 0; round < 2000; round++) {
+        // Random text of strings and other stuff, long enough to span blocks.
+        // Strings contain escaped quotes and runs of escaped backslashes.
+        std::string json;
+        size_t n = std::rand() % 300;
+        while (json.size() < n) {
+            if (std::rand() % 4) {
+                json.push_back(outside[std::rand() % (sizeof(outside) - 1)]);
+                continue;
+            }
+            json.push_back('"');
+            for (int k = std::rand() % 20; k > 0; k--) {
+                int r = std::rand() % 4;
+                if (r == 0) {
+                    json.append("\\\"");
+                } else if (r == 1) {
+                    json.append(2 * (std::rand() % 4), '\\');
+                } else {
+                    json.push_back(inside[std::rand() % (sizeof(inside) - 1)]);
+                }
+            }
+            json.push_back('"');
+        }
+        auto expected = naive_structurals(json);
+        for (auto level : levels()) {
+            JsonStructuralIndex index(level);
+            index.build(json.data(), json.size());
+            assert(index.positions() == expected);
+        }
+    }
+    std::cout << "structurals: OK" << std::endl;
+}
+
+
+void test_parse()
+{
+    std::string json = R"({"a": 1, "b": [true, false, null], "c": {"d": -2.5e1, "e": ""},
+        "f": "x\"y\\z\n\u00e9\ud83d\ude00", "g": [], "h": {}, "i": -3,
+        "j": 4294967296, "k": -2147483649, "l": 18446744073709551616, "m": 0.5})";
+    std::string expected =
+        "{ k'a' u1 k'b' [ true false null ]3 k'c' { k'd' d-25 k'e' s'' }2 "
+        "k'f' s'x\"y\\z\n\xc3\xa9\xf0\x9f\x98\x80' k'g' [ ]0 k'h' { }0 k'i' i-3 "
+        "k'j' U4294967296 k'k' I-2147483649 k'l' d1.84467e+19 k'm' d0.5 }11 ";
+    for (auto level : levels()) {
+        auto z = events(json, level);
+        std::cout << z << std::endl;
+        assert(z == expected);
+        assert(events("  7 ", level) == "u7 ");
+        assert(events("\"abc\"", level) == "s'abc' ");
+    }
+
+    // A long document, to cross many blocks.
+    std::string big = "[";
+    std::string big_expected = "[ ";
+    for (int i = 0; i < 1000; i++) {
+        big += (i ? ", " : "") + std::string("{\"key\\\\\": \"v") + std::to_string(i) + "\"}";
+        big_expected += "{ k'key\\' s'v" + std::to_string(i) + "' }1 ";
+    }
+    big += "]";
+    big_expected += "]1000 ";
+    for (auto level : levels()) {
+        assert(events(big, level) == big_expected);
+    }
+    std::cout << "parse: OK" << std::endl;
+}
+
+
+void test_shallow()
+{
+    std::string json = R"( {"a": [1, {"x": "]"}], "b": 2, "c": {"d": "\"}["}, "e": []} )";
+    JsonSimdParser parser;
+    EventWriter w;
+    parser.parse_shallow(json.data(), json.size(), 0, w);
+    std::cout << w.out.str() << std::endl;
+    assert(w.out.str() == "{ k'a' ~7-22 k'b' u2 k'c' ~37-50 k'e' ~57-59 }4 ");
+    assert(json.substr(37, 13) == R"({"d": "\"}["})");
+
+    // A skipped value, parsed by itself.
+    EventWriter w2;
+    parser.parse_shallow(json.data(), 22, 7, w2);
+    assert(w2.out.str() == "[ u1 ~11-21 ]2 ");
+
+    EventWriter w3;
+    parser.parse_shallow(json.data(), 50, 37, w3);
+    assert(w3.out.str() == "{ k'd' s'\"}[' }1 ");
+
+    for (auto bad : {"[1, [2, 3]", "{\"a\": {\"b\": \"}\"}", "[1] 2", "[{} {}]"}) {
+        EventWriter w4;
+        bool failed = false;
+        try {
+            parser.parse_shallow(bad, std::strlen(bad), 0, w4);
+        } catch (Error const& e) {
+            failed = true;
+        }
+        assert(failed);
+    }
+    std::cout << "shallow: OK" << std::endl;
+}
+
+
+void test_split()
+{
+    std::string json = R"( [{"a": [1, 2]}, "x,]", 3, [4, 5], {"b": "\"]"}, 6] )";
+    for (auto level : levels()) {
+        JsonStructuralIndex index(level);
+        // Each run is at least a third of the document long, except the last.
+        auto bounds = index.split_array(json.data(), json.size(), 3);
+        std::vector<size_t> expected{1, 22, 47, 50};
+        assert(bounds == expected);
+        assert(json.substr(23, 24) == R"( 3, [4, 5], {"b": "\"]"})");
+
+        bounds = index.split_array(json.data(), json.size(), 100);
+        expected = {1, 15, 22, 25, 33, 47, 50};
+        assert(bounds == expected);
+
+        assert(index.split_array(json.data(), json.size(), 1).size() == 2);
+        assert(index.split_array("[]", 2, 4) == (std::vector<size_t>{0, 1}));
+        assert(index.split_array(" {\"a\": 1}", 10, 4).empty());
+        assert(index.split_array("3", 1, 4).empty());
+
+        for (auto bad : {"[1, [2]", "[1]]", "[1] 2", "[\"a]"}) {
+            bool failed = false;
+            try {
+                index.split_array(bad, std::strlen(bad), 4);
+            } catch (Error const& e) {
+                failed = true;
+            }
+            assert(failed);
+        }
+    }
+    std::cout << "split: OK" << std::endl;
+}
+
+
+void test_errors()
+{
+    std::vector<std::string> bad{
+        "", "   ", "[1, 2", "[1 2]", "{\"a\" 1}", "{\"a\": 1,}", "[1,]", "{1: 2}",
+        "\"abc", "[01]", "[1.]", "[-]", "[1e]", "[tru]", "[truex]", "[nul]",
+        "[1] 2", "[1}", "{\"a\": 1]", "[\"\\x\"]", "[\"\\ud800\"]", "[\"a\tb\"]",
+        "[1x]", "[\"a\"\"b\"]", "[-inf]", "[1e999]",
+    };
+    for (auto level : levels()) {
+        for (auto const& json : bad) {
+            if (!fails(json, level)) {
+                std::cout << "should fail: " << json << std::endl;
+                assert(false);
+            }
+        }
+    }
+    std::cout << "errors: OK" << std::endl;
+}
+
+
+int main()
+{
+    std::cout << "best level: " << static_cast<int>(JsonStructuralIndex::best_level()) << std::endl;
+    test_structurals();
+    test_parse();
+    test_shallow();
+    test_split();
+    test_errors();
+}
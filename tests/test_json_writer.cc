@@ -0,0 +1,98 @@
+#include "zpz/io.h"
+#include "zpz/json_writer.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace zpz;
+
+
+template <typename T>
+std::string to_json(T const& x)
+{
+    JsonWriter w;
+    w.write(x);
+    return w.str();
+}
+
+
+void test_scalars()
+{
+    assert(to_json(true) == "true");
+    assert(to_json(-12) == "-12");
+    assert(to_json(18446744073709551615ULL) == "18446744073709551615");
+    assert(to_json(0.1) == "0.1");
+    assert(to_json(1e300) == "1e+300");
+    assert(to_json(0.1f) == "0.1");
+    assert(to_json(std::numeric_limits<double>::quiet_NaN()) == "null");
+    assert(to_json(-std::numeric_limits<double>::infinity()) == "null");
+
+    // Shortest text that round-trips.
+    std::srand(3);
+    for (int i = 0; i < 10000; i++) {
+        double x = (std::rand() - RAND_MAX / 2) / 7.0 * std::pow(10.0, std::rand() % 40 - 20);
+        auto z = to_json(x);
+        assert(std::strtod(z.c_str(), nullptr) == x);
+    }
+
+    assert(to_json("abc") == "\"abc\"");
+    assert(to_json(std::string("a\"b\\c\nd\te\x01")) == "\"a\\\"b\\\\c\\nd\\te\\u0001\"");
+    assert(to_json(std::string("caf\xc3\xa9")) == "\"caf\xc3\xa9\"");
+    std::cout << "scalars: OK" << std::endl;
+}
+
+
+void test_containers()
+{
+    assert(to_json(std::vector<int>{}) == "[]");
+    assert(to_json(std::vector<double>{1.5, -2, 3}) == "[1.5,-2,3]");
+    assert(to_json(std::vector<bool>{true, false}) == "[true,false]");
+    assert(to_json(std::make_pair(std::string("a"), 1)) == "[\"a\",1]");
+
+    std::map<std::string, std::vector<double>> m{{"x", {1, 2}}, {"y\"", {}}};
+    assert(to_json(m) == "{\"x\":[1,2],\"y\\\"\":[]}");
+
+    std::map<int, std::map<std::string, double>> nested{{1, {{"a", 0.5}}}, {2, {}}};
+    assert(to_json(nested) == "{\"1\":{\"a\":0.5},\"2\":{}}");
+
+    std::unordered_map<std::string, int> u{{"k", 3}};
+    assert(to_json(u) == "{\"k\":3}");
+
+    std::vector<std::pair<int, std::vector<std::string>>> v{{1, {"a", "b"}}};
+    assert(to_json(v) == "[[1,[\"a\",\"b\"]]]");
+
+    // The buffer is reused.
+    JsonWriter w;
+    w.write(m);
+    w.clear();
+    w.write(1);
+    assert(w.view() == "1");
+    std::cout << "containers: OK" << std::endl;
+}
+
+
+void test_stream()
+{
+    // The stream operators in io.h separate map entries.
+    std::map<std::string, int> m{{"a", 1}, {"b", 2}};
+    std::ostringstream ss;
+    ss << m;
+    std::cout << ss.str() << std::endl;
+    assert(ss.str() == "{\"a\": \"1\", \"b\": \"2\"}");
+}
+
+
+int main()
+{
+    test_scalars();
+    test_containers();
+    test_stream();
+}
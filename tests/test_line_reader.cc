@@ -0,0 +1,147 @@
+#include "zpz/line_reader.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace zpz;
+
+
+// Lines by std::getline, plus the last line if not terminated.
+std::vector<std::string> expected_lines(std::string const& text)
+{
+    std::vector<std::string> z;
+    size_t p = 0;
+    while (p < text.size()) {
+        auto q = text.find('\n', p);
+        if (q == std::string::npos) {
+            q = text.size();
+        }
+        z.push_back(text.substr(p, q - p));
+        p = q + 1;
+    }
+    return z;
+}
+
+
+std::string random_text(size_t n_lines, size_t max_length)
+{
+    std::string text;
+    for (size_t i = 0; i < n_lines; i++) {
+        size_t n = std::rand() % (max_length + 1);
+        for (size_t j = 0; j < n; j++) {
+            text.push_back(std::rand() % 8 ? 'a' + std::rand() % 26 : '\t');
+        }
+        text.push_back('\n');
+    }
+    return text;
+}
+
+
+void test_range()
+{
+    std::srand(5);
+    for (int round = 0; round < 500; round++) {
+        auto text = random_text(std::rand() % 50, std::rand() % 200);
+        if (std::rand() % 2) {
+            text += "no newline";
+        }
+        std::vector<std::string> lines;
+        LineRange range(text.data(), text.size());
+        std::string_view line;
+        while (range.next(line)) {
+            lines.emplace_back(line);
+        }
+        assert(lines == expected_lines(text));
+
+        // The ranges of a split hold the same lines, each range whole lines.
+        size_t n = std::rand() % 8 + 1;
+        auto parts = LineRange(text.data(), text.size()).split(n);
+        assert(parts.size() <= n);
+        lines.clear();
+        size_t total = 0;
+        for (auto& part : parts) {
+            total += part.size();
+            assert(part.data()[part.size() - 1] == '\n' || part.data() + part.size() == text.data() + text.size());
+            while (part.next(line)) {
+                lines.emplace_back(line);
+            }
+        }
+        assert(total == text.size());
+        assert(lines == expected_lines(text));
+    }
+
+    // Not final: the last line is held back.
+    std::string text = "a\nbc\nde";
+    LineRange range(text.data(), text.size(), false);
+    std::string_view line;
+    [[maybe_unused]] bool more = range.next(line);
+    assert(more && line == "a");
+    more = range.next(line);
+    assert(more && line == "bc");
+    more = range.next(line);
+    assert(!more);
+    assert(range.remainder() == "de");
+    std::cout << "range: OK" << std::endl;
+}
+
+
+void test_reader(std::string const& filename, std::string const& text)
+{
+    auto expected = expected_lines(text);
+
+    LineReader reader(filename);
+    std::vector<std::string> lines;
+    std::string_view line;
+    while (reader.next(line)) {
+        lines.emplace_back(line);
+    }
+    assert(lines == expected);
+
+    // A source in small chunks, shorter than some lines.
+    size_t pos = 0;
+    LineReader chunked([&](char* buffer, size_t size) {
+        size_t n = std::min<size_t>({size, text.size() - pos, 1000});
+        std::memcpy(buffer, text.data() + pos, n);
+        pos += n;
+        return n;
+    }, 100);
+    lines.clear();
+    while (chunked.next(line)) {
+        lines.emplace_back(line);
+    }
+    assert(lines == expected);
+
+    LineReader parallel(filename);
+    std::vector<std::vector<std::string>> parts(4);
+    parallel.for_each_line([&](size_t i, std::string_view line) {
+        parts[i].emplace_back(line);
+    }, 4);
+    lines.clear();
+    for (auto const& p : parts) {
+        lines.insert(lines.end(), p.begin(), p.end());
+    }
+    assert(lines == expected);
+    std::cout << "reader: OK" << std::endl;
+}
+
+
+int main()
+{
+    test_range();
+
+    std::string filename = "/tmp/zpz_test_line_reader.txt";
+    auto text = random_text(200000, 300) + "last";
+    {
+        std::ofstream f(filename, std::ios::binary);
+        f << text;
+    }
+    test_reader(filename, text);
+    std::remove(filename.c_str());
+}
@@ -0,0 +1,82 @@
+#include "zpz/io.h"
+#include "zpz/mapped_file.h"
+
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+using namespace zpz;
+
+
+int main()
+{
+    std::string filename = "/tmp/zpz_test_mapped_file.txt";
+    std::string content = "first line\nsecond line\n";
+    {
+        std::ofstream f(filename, std::ios::binary);
+        f << content;
+    }
+
+    MappedFile mf(filename);
+    assert(mf.size() == content.size());
+    assert(std::string(mf.data(), mf.size()) == content);
+
+    assert(mf.is_mapped());
+    assert(mf.view() == content);
+    assert(mf.bytes()[6] == std::byte{'l'});
+
+    MappedFile populated(filename, MADV_SEQUENTIAL, false, true);
+    assert(populated.view() == content);
+    assert(read_text_file(filename) == content);
+    assert(read_binary_file(filename) == content);
+
+    MappedFile moved = std::move(mf);
+    assert(mf.data() == nullptr);
+    assert(std::string(moved.data(), moved.size()) == content);
+    std::cout << std::string(moved.data(), moved.size());
+
+    MappedFile cow(filename, MADV_SEQUENTIAL, true);
+    assert(cow.data()[cow.size()] == '\0');
+    cow.mutable_data()[0] = 'F';
+    assert(std::string(cow.data(), 5) == "First");
+    MappedFile again(filename);
+    assert(std::string(again.data(), 5) == "first");
+
+    // Size is a multiple of the page size, hence the terminating zero
+    // is not on the last page of the file.
+    {
+        std::ofstream f(filename, std::ios::binary | std::ios::trunc);
+        f << std::string(4096 * 2, 'x');
+    }
+    MappedFile paged(filename, MADV_SEQUENTIAL, true);
+    assert(paged.size() == 4096 * 2);
+    assert(paged.data()[paged.size()] == '\0');
+
+    {
+        std::ofstream f(filename, std::ios::binary | std::ios::trunc);
+    }
+    MappedFile empty(filename);
+    assert(empty.empty());
+    assert(read_text_file(filename).empty());
+    MappedFile empty_cow(filename, MADV_SEQUENTIAL, true);
+    assert(empty_cow.data()[0] == '\0');
+
+    // Files in /proc claim to be empty and can not be mapped; they are read instead.
+    MappedFile proc("/proc/self/status");
+    assert(!proc.is_mapped());
+    assert(proc.view().find("Name:") == 0);
+    assert(proc.data()[proc.size()] == '\0');
+
+    bool thrown = false;
+    try {
+        read_text_file("/tmp/zpz_no_such_file");
+    } catch (Error const& e) {
+        thrown = true;
+        std::cout << e.what() << std::endl;
+    }
+    assert(thrown);
+
+    std::remove(filename.c_str());
+}
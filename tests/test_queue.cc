@@ -0,0 +1,57 @@
+#include "zpz/queue.h"
+
+#include <cassert>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace zpz;
+
+
+int main()
+{
+    BlockingQueue<int> q(4);
+    long const n = 10000;
+
+    std::vector<long> sums(3, 0);
+    std::vector<std::thread> consumers;
+    for (size_t i = 0; i < sums.size(); i++) {
+        consumers.emplace_back([&q, &sums, i] {
+            int x;
+            while (q.pop(x)) {
+                sums[i] += x;
+            }
+        });
+    }
+
+    for (int i = 1; i <= n; i++) {
+        [[maybe_unused]] bool pushed = q.push(i);
+        assert(pushed);
+    }
+    q.close();
+    for (auto& t : consumers) {
+        t.join();
+    }
+
+    long total = 0;
+    for (auto s : sums) {
+        total += s;
+    }
+    std::cout << "total: " << total << std::endl;
+    assert(total == n * (n + 1) / 2);
+
+    [[maybe_unused]] bool pushed = q.push(1);
+    assert(!pushed);
+    int x;
+    [[maybe_unused]] bool popped = q.pop(x);
+    assert(!popped);
+
+    BlockingQueue<int> r(2);
+    popped = r.try_pop(x);
+    assert(!popped);
+    r.push(5);
+    popped = r.try_pop(x);
+    assert(popped && x == 5);
+    popped = r.try_pop(x);
+    assert(!popped);
+}